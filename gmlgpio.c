@@ -53,11 +53,23 @@ __FBSDID("$FreeBSD$");
 #include <sys/kernel.h>
 #include <sys/module.h>
 #include <sys/endian.h>
+#include <sys/fcntl.h>
 #include <sys/rman.h>
+#include <sys/sbuf.h>
 #include <sys/types.h>
 #include <sys/malloc.h>
-
+#include <sys/conf.h>
+#include <sys/lock.h>
+#include <sys/sx.h>
+#include <sys/callout.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#include <sys/timepps.h>
+#include <sys/uio.h>
+
+#include <machine/atomic.h>
 #include <machine/bus.h>
+#include <machine/cpufunc.h>
 #include <machine/resource.h>
 
 #include <contrib/dev/acpica/include/acpi.h>
@@ -71,6 +83,8 @@ __FBSDID("$FreeBSD$");
 #include "gpio_if.h"
 
 #include "gmlgpio_reg.h"
+#include "gmlgpio_ioctl.h"
+#include "gmlgpiovar.h"
 
 /*
  *     Macros for driver mutex locking
@@ -84,12 +98,68 @@ __FBSDID("$FreeBSD$");
 #define GMLGPIO_ASSERT_LOCKED(_sc)      mtx_assert(&(_sc)->sc_mtx, MA_OWNED)
 #define GMLGPIO_ASSERT_UNLOCKED(_sc) 	mtx_assert(&(_sc)->sc_mtx, MA_NOTOWNED)
 
+#ifdef GMLGPIO_MMIO_STATS
+/* Register accesses timed when built with GMLGPIO_MMIO_STATS */
+#define	GMLGPIO_MMIO_PAD_READ	0
+#define	GMLGPIO_MMIO_PAD_WRITE	1
+#define	GMLGPIO_MMIO_IS_READ	2
+#define	GMLGPIO_MMIO_IS_WRITE	3
+#define	GMLGPIO_MMIO_PADBAR	4
+#define	GMLGPIO_MMIO_DW1_READ	5
+#define	GMLGPIO_MMIO_DW1_WRITE	6
+#define	GMLGPIO_MMIO_NTYPES	7
+#define	GMLGPIO_MMIO_BUCKETS	32
+
+static const char *gmlgpio_mmio_names[GMLGPIO_MMIO_NTYPES] = {
+	"pad_read", "pad_write", "gpi_is_read", "gpi_is_write", "padbar_read",
+	"pad_dw1_read", "pad_dw1_write"
+};
+#endif
+
+/*
+ * Pin changes streamed as a VCD file through /dev/gmlgpioN.vcd and
+ * /dev/gmlgpio.vcd.  Changes are queued in a fixed ring while the device
+ * is open and formatted as the reader consumes them; when the ring is
+ * full further changes are counted and dropped.
+ */
+#define	GMLGPIO_VCD_EVENTS	4096
+#define	GMLGPIO_VCD_CHUNK	64	/* Events formatted per refill */
+
+struct gmlgpio_vcd_event {
+	uint64_t	ve_time;	/* ns since the device was opened */
+	uint16_t	ve_slot;	/* Community, _UID - 1 */
+	uint16_t	ve_pin;
+	uint32_t	ve_value;
+};
+
+struct gmlgpio_vcd {
+	struct mtx	vc_mtx;		/* Ring, taken from the filter */
+	struct sx	vc_lock;	/* Reader state */
+	bool		vc_active;
+	bool		vc_sleeping;
+	bool		vc_gone;
+	struct gmlgpio_vcd_event *vc_ring;
+	u_int		vc_head;
+	u_int		vc_count;
+	uint64_t	vc_dropped;
+	sbintime_t	vc_start;
+	uint64_t	vc_last;	/* Last timestamp written */
+	uint32_t	vc_slots;	/* Communities in the header */
+	struct sbuf	*vc_out;
+	ssize_t		vc_outoff;
+};
+
+/* Debounce timer wheel, one millisecond per slot */
+#define	GMLGPIO_WHEEL_SLOTS	256
+#define	GMLGPIO_WHEEL_TICK	SBT_1MS
+
 struct gmlgpio_softc {
 	device_t 	sc_dev;
 	device_t 	sc_busdev;
 	struct mtx 	sc_mtx;
 
 	ACPI_HANDLE	sc_handle;
+	int		sc_uid;
 
 	int		sc_mem_rid;
 	struct resource *sc_mem_res;
@@ -104,17 +174,226 @@ struct gmlgpio_softc {
 	int 		sc_ngroups;
 	int		sc_padbar;
 	const char **sc_pin_names;
+
+	struct cdev	*sc_cdev;
+	struct cdev	*sc_vcd_cdev;
+	struct gmlgpio_vcd sc_vcd;
+
+	/* Pin state change tracking for GMLGPIO_SNAPSHOT */
+	uint64_t	sc_gen;
+	uint32_t	sc_state[GMLGPIO_MAPWORDS];
+	uint64_t	sc_pin_gen[GMLGPIO_MAXPINS];
+
+	/* Virtual parallel port */
+	struct gmlgpio_port sc_port;
+	uint64_t	sc_port_words;
+	uint64_t	sc_port_rate;
+
+	/* Pin event subscribers */
+	struct gmlgpio_handler {
+		gmlgpio_intr_t	*ih_fn;
+		void		*ih_arg;
+		uint32_t	ih_mode;
+		u_int		ih_busy;	/* Calls in progress */
+		bool		ih_dying;	/* Being disestablished */
+	}		sc_handlers[GMLGPIO_MAXPINS];
+	uint32_t	sc_filter_mask[GMLGPIO_MAPWORDS];
+	uint32_t	sc_level_mask[GMLGPIO_MAPWORDS];
+	uint32_t	sc_thread_pending[GMLGPIO_MAPWORDS];
+
+	/* Timed output events, sorted latest first */
+	struct callout	sc_sched_callout;
+	struct gmlgpio_sched_event {
+		sbintime_t	se_when;
+		int		se_pin;
+		unsigned int	se_value;
+	}		sc_sched[GMLGPIO_MAXEVENTS];
+	int		sc_nsched;
+	uint64_t	sc_sched_tolerance;	/* ns */
+	uint64_t	sc_sched_events;
+	uint64_t	sc_sched_errors;
+	uint64_t	sc_sched_late_sum;	/* ns */
+	uint64_t	sc_sched_late_max;	/* ns */
+	uint64_t	sc_sched_early_sum;	/* ns */
+	uint64_t	sc_sched_early_max;	/* ns */
+
+	/* Interrupt storm detection */
+	struct gmlgpio_storm {
+		sbintime_t	st_window;	/* Start of counting window */
+		sbintime_t	st_until;	/* End of masking or backoff */
+		uint32_t	st_count;
+		uint32_t	st_backoff;	/* ms */
+	}		sc_storm[GMLGPIO_MAXPINS];
+	uint32_t	sc_storm_masked[GMLGPIO_MAPWORDS];
+	uint32_t	sc_storm_report[GMLGPIO_MAPWORDS];
+	struct callout	sc_storm_callout;
+	sbintime_t	sc_storm_next;
+	u_int		sc_storm_threshold;
+	uint64_t	sc_storms;
+	uint64_t	sc_intr_unhandled;
+	struct timeval	sc_storm_lastlog;
+	struct timeval	sc_intr_lastlog;
+
+	/*
+	 * Software debounce.  Pins waiting for their level to settle are
+	 * hashed by deadline into the slots of a timer wheel, each slot a
+	 * doubly linked list of pins, so arming and cancelling are O(1).
+	 * The callout is only set for the nearest deadline, never earlier
+	 * than needed to catch it.
+	 */
+	struct gmlgpio_debounce_pin {
+		uint16_t	db_rise;	/* ms */
+		uint16_t	db_fall;	/* ms */
+		int16_t		db_next;	/* Wheel slot list, -1 ends */
+		int16_t		db_prev;
+		uint64_t	db_deadline;	/* Wheel tick */
+	}		sc_debounce[GMLGPIO_MAXPINS];
+	uint32_t	sc_debounce_mask[GMLGPIO_MAPWORDS];
+	uint32_t	sc_debounce_armed[GMLGPIO_MAPWORDS];
+	int16_t		sc_wheel[GMLGPIO_WHEEL_SLOTS];
+	u_int		sc_wheel_count;
+	uint64_t	sc_wheel_tick;		/* Next tick to expire */
+	uint64_t	sc_wheel_next;		/* Tick the callout is set for */
+	struct callout	sc_wheel_callout;
+
+	/* PPS source */
+	int		sc_pps_pin;		/* -1 if unused */
+	struct pps_state sc_pps;
+
+#ifdef GMLGPIO_MMIO_STATS
+	/* log2 histograms of TSC ticks per register access */
+	uint64_t	sc_mmio_hist[GMLGPIO_MMIO_NTYPES][GMLGPIO_MMIO_BUCKETS];
+#endif
 };
 
+/*
+ * A pin taking more than sc_storm_threshold interrupts in one window is
+ * masked, for a backoff that doubles with each storm and is forgotten
+ * once the pin has been quiet for GMLGPIO_STORM_FORGET after unmasking.
+ */
+#define	GMLGPIO_STORM_WINDOW		(100 * SBT_1MS)
+#define	GMLGPIO_STORM_THRESHOLD		500
+#define	GMLGPIO_STORM_BACKOFF_MIN	10		/* ms */
+#define	GMLGPIO_STORM_BACKOFF_MAX	10000		/* ms */
+#define	GMLGPIO_STORM_FORGET		(60 * SBT_1S)
+
+static const struct timeval gmlgpio_log_interval = { 1, 0 };
+
+/* Default window for writing timed events in one pass */
+#define	GMLGPIO_SCHED_TOLERANCE	10000	/* ns */
+#define	GMLGPIO_SCHED_TOLERANCE_MAX	1000000000	/* ns */
+
+/*
+ * Attached communities, indexed by _UID - 1, and the /dev/gmlgpio device
+ * that spans them.
+ */
+#define	GMLGPIO_NCOMMUNITIES	4
+
+static struct gmlgpio_softc *gmlgpio_communities[GMLGPIO_NCOMMUNITIES];
+static struct sx gmlgpio_communities_lock;
+SX_SYSINIT(gmlgpio_communities, &gmlgpio_communities_lock,
+    "gmlgpio communities");
+static struct cdev *gmlgpio_all_cdev;
+static struct cdev *gmlgpio_all_vcd_cdev;
+
+static struct gmlgpio_vcd gmlgpio_all_vcd;
+MTX_SYSINIT(gmlgpio_all_vcd_mtx, &gmlgpio_all_vcd.vc_mtx, "gmlgpio vcd",
+    MTX_SPIN);
+SX_SYSINIT(gmlgpio_all_vcd_sx, &gmlgpio_all_vcd.vc_lock, "gmlgpio vcd reader");
+
+static MALLOC_DEFINE(M_GMLGPIO, "gmlgpio", "Gemini Lake GPIO");
+
+/* Bytes copied in per spin lock hold when streaming to the port */
+#define	GMLGPIO_PORT_CHUNK	128
+
+static int gmlgpio_filter(void *);
+static void gmlgpio_sched_run(void *);
+static void gmlgpio_storm_run(void *);
+static void gmlgpio_pps_event(struct gmlgpio_softc *);
+static void gmlgpio_wheel_run(void *);
 static void gmlgpio_intr(void *);
 static int gmlgpio_probe(device_t);
 static int gmlgpio_attach(device_t);
 static int gmlgpio_detach(device_t);
 
+static d_ioctl_t gmlgpio_ioctl;
+static d_write_t gmlgpio_write;
+static d_ioctl_t gmlgpio_all_ioctl;
+static d_open_t gmlgpio_vcd_open;
+static d_close_t gmlgpio_vcd_close;
+static d_read_t gmlgpio_vcd_read;
+static d_purge_t gmlgpio_vcd_purge;
+
+static struct cdevsw gmlgpio_cdevsw = {
+	.d_version =	D_VERSION,
+	.d_name =	"gmlgpio",
+	.d_ioctl =	gmlgpio_ioctl,
+	.d_write =	gmlgpio_write,
+};
+
+static struct cdevsw gmlgpio_all_cdevsw = {
+	.d_version =	D_VERSION,
+	.d_name =	"gmlgpio",
+	.d_ioctl =	gmlgpio_all_ioctl,
+};
+
+static struct cdevsw gmlgpio_vcd_cdevsw = {
+	.d_version =	D_VERSION,
+	.d_name =	"gmlgpio",
+	.d_open =	gmlgpio_vcd_open,
+	.d_close =	gmlgpio_vcd_close,
+	.d_read =	gmlgpio_vcd_read,
+	.d_purge =	gmlgpio_vcd_purge,
+};
+
+/*
+ * Register access.  With GMLGPIO_MMIO_STATS each access is bracketed by
+ * TSC reads and counted in the histogram for its type.  Writes are
+ * posted, so their figures only cover getting the write onto the fabric.
+ */
+#ifdef GMLGPIO_MMIO_STATS
+static inline void
+gmlgpio_mmio_record(struct gmlgpio_softc *sc, int type, uint64_t ticks)
+{
+	int bucket;
+
+	bucket = MIN(flsll(ticks), GMLGPIO_MMIO_BUCKETS - 1);
+	atomic_add_64(&sc->sc_mmio_hist[type][bucket], 1);
+}
+
+static inline uint32_t
+gmlgpio_read_4(struct gmlgpio_softc *sc, int type, bus_size_t offset)
+{
+	uint64_t tsc;
+	uint32_t val;
+
+	tsc = rdtsc_ordered();
+	val = bus_read_4(sc->sc_mem_res, offset);
+	gmlgpio_mmio_record(sc, type, rdtsc_ordered() - tsc);
+	return (val);
+}
+
+static inline void
+gmlgpio_write_4(struct gmlgpio_softc *sc, int type, bus_size_t offset,
+    uint32_t val)
+{
+	uint64_t tsc;
+
+	tsc = rdtsc_ordered();
+	bus_write_4(sc->sc_mem_res, offset, val);
+	gmlgpio_mmio_record(sc, type, rdtsc_ordered() - tsc);
+}
+#else
+#define	gmlgpio_read_4(sc, type, offset)				\
+	bus_read_4((sc)->sc_mem_res, (offset))
+#define	gmlgpio_write_4(sc, type, offset, val)				\
+	bus_write_4((sc)->sc_mem_res, (offset), (val))
+#endif
+
 static inline int
 gmlgpio_read_padbar(struct gmlgpio_softc *sc)
 {
-	return bus_read_4(sc->sc_mem_res, GML_PADBAR);
+	return gmlgpio_read_4(sc, GMLGPIO_MMIO_PADBAR, GML_PADBAR);
 }
 
 static inline int
@@ -126,22 +405,151 @@ gmlgpio_pad_cfg_dw0_offset(struct gmlgpio_softc *sc, int pin)
 static inline int
 gmlgpio_read_pad_cfg_dw0(struct gmlgpio_softc *sc, int pin)
 {
-	return bus_read_4(sc->sc_mem_res, gmlgpio_pad_cfg_dw0_offset(sc, pin));
+	return gmlgpio_read_4(sc, GMLGPIO_MMIO_PAD_READ,
+	    gmlgpio_pad_cfg_dw0_offset(sc, pin));
 }
 
 static inline void
 gmlgpio_write_pad_cfg_dw0(struct gmlgpio_softc *sc, int pin, uint32_t val)
 {
-	bus_write_4(sc->sc_mem_res, gmlgpio_pad_cfg_dw0_offset(sc, pin), val);
+	gmlgpio_write_4(sc, GMLGPIO_MMIO_PAD_WRITE,
+	    gmlgpio_pad_cfg_dw0_offset(sc, pin), val);
+}
+
+/* offset selects the register within the GPI_IS bank */
+static inline uint32_t
+gmlgpio_read_gpi_is(struct gmlgpio_softc *sc, bus_size_t offset)
+{
+	return (gmlgpio_read_4(sc, GMLGPIO_MMIO_IS_READ, GML_GPI_IS_0 + offset));
+}
+
+static inline void
+gmlgpio_write_gpi_is(struct gmlgpio_softc *sc, bus_size_t offset, uint32_t val)
+{
+	gmlgpio_write_4(sc, GMLGPIO_MMIO_IS_WRITE, GML_GPI_IS_0 + offset, val);
+}
+
+/*
+ * GPI_IS and GPI_IE hold one bit per pad, 32 pads per register, in pad order.
+ */
+static inline bus_size_t
+gmlgpio_gpi_offset(int pin)
+{
+	return (4 * (pin / 32));
+}
+
+static inline uint32_t
+gmlgpio_gpi_bit(int pin)
+{
+	return (1U << (pin % 32));
+}
+
+/*
+ * Pin value as seen by gmlgpio_pin_get():
+ * If RXDIS is not set, read RXSTATE.
+ * If RXDIS is set, read TXSTATE.
+ */
+static inline unsigned int
+gmlgpio_pad_value(uint32_t val)
+{
+	if (!(val & GML_GPIO_PAD_CFG_DW0_GPIORXDIS))
+		return ((val & GML_GPIO_PAD_CFG_DW0_GPIORXSTATE) ?
+		    GPIO_PIN_HIGH : GPIO_PIN_LOW);
+	return ((val & GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE) ?
+	    GPIO_PIN_HIGH : GPIO_PIN_LOW);
+}
+
+/* Queue a pin change for a VCD reader */
+static void
+gmlgpio_vcd_record(struct gmlgpio_vcd *vc, int slot, int pin,
+    unsigned int value)
+{
+	struct gmlgpio_vcd_event *ve;
+
+	if (!vc->vc_active)
+		return;
+
+	mtx_lock_spin(&vc->vc_mtx);
+	if (vc->vc_ring == NULL) {
+		mtx_unlock_spin(&vc->vc_mtx);
+		return;
+	}
+	if (vc->vc_count == GMLGPIO_VCD_EVENTS) {
+		vc->vc_dropped++;
+	} else {
+		ve = &vc->vc_ring[(vc->vc_head + vc->vc_count) %
+		    GMLGPIO_VCD_EVENTS];
+		ve->ve_time = sbttons(sbinuptime() - vc->vc_start);
+		ve->ve_slot = slot;
+		ve->ve_pin = pin;
+		ve->ve_value = value;
+		vc->vc_count++;
+	}
+	if (vc->vc_sleeping) {
+		vc->vc_sleeping = false;
+		wakeup(vc);
+	}
+	mtx_unlock_spin(&vc->vc_mtx);
+}
+
+/*
+ * Record the current value of a pin, bumping the generation if it changed.
+ */
+static void
+gmlgpio_track(struct gmlgpio_softc *sc, int pin, unsigned int value)
+{
+	uint32_t bit;
+	int word;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	word = pin / 32;
+	bit = gmlgpio_gpi_bit(pin);
+	if (((sc->sc_state[word] & bit) != 0) == (value != GPIO_PIN_LOW))
+		return;
+	sc->sc_state[word] ^= bit;
+	sc->sc_pin_gen[pin] = ++sc->sc_gen;
+
+	gmlgpio_vcd_record(&sc->sc_vcd, sc->sc_uid - 1, pin,
+	    value != GPIO_PIN_LOW);
+	gmlgpio_vcd_record(&gmlgpio_all_vcd, sc->sc_uid - 1, pin,
+	    value != GPIO_PIN_LOW);
+}
+
+/*
+ * Resample the pins flagged in one GPI_IS register.  The caller has already
+ * acked them, so a change after the DW0 read latches again.
+ */
+static void
+gmlgpio_track_latched(struct gmlgpio_softc *sc, int word, uint32_t bits)
+{
+	int line;
+	int pin;
+
+	for (line = 0; line < 32; line++) {
+		if ((bits & (1U << line)) == 0)
+			continue;
+		pin = word * 32 + line;
+		if (pin >= sc->sc_npins)
+			break;
+		gmlgpio_track(sc, pin,
+		    gmlgpio_pad_value(gmlgpio_read_pad_cfg_dw0(sc, pin)));
+	}
 }
 
-#ifdef notdef		/* Unused for now */
 static inline int
 gmlgpio_read_pad_cfg_dw1(struct gmlgpio_softc *sc, int pin)
 {
-	return bus_read_4(sc->sc_mem_res, gmlgpio_pad_cfg_dw0_offset(sc, pin) + 4);
+	return gmlgpio_read_4(sc, GMLGPIO_MMIO_DW1_READ,
+	    gmlgpio_pad_cfg_dw0_offset(sc, pin) + 4);
+}
+
+static inline void
+gmlgpio_write_pad_cfg_dw1(struct gmlgpio_softc *sc, int pin, uint32_t val)
+{
+	gmlgpio_write_4(sc, GMLGPIO_MMIO_DW1_WRITE,
+	    gmlgpio_pad_cfg_dw0_offset(sc, pin) + 4, val);
 }
-#endif
 
 static device_t
 gmlgpio_get_bus(device_t dev)
@@ -198,11 +606,185 @@ gmlgpio_pin_getcaps(device_t dev, uint32_t pin, uint32_t *caps)
 		return (EINVAL);
 
 	/* Fixed capabilities */
-	*caps = GPIO_PIN_INPUT | GPIO_PIN_OUTPUT;
+	*caps = GPIO_PIN_INPUT | GPIO_PIN_OUTPUT |
+	    GPIO_INTR_LEVEL_LOW | GPIO_INTR_LEVEL_HIGH |
+	    GPIO_INTR_EDGE_RISING | GPIO_INTR_EDGE_FALLING | GPIO_INTR_EDGE_BOTH;
 
 	return (0);
 }
 
+/*
+ * Translate between GPIO_INTR_* flags and the pad's RXEVCFG/RXINV bits.
+ * Active low modes are handled by inverting the receive path, so the
+ * hardware always detects a high level or a rising edge.  RXINV does not
+ * affect GPIORXSTATE, so pin reads are unchanged.
+ */
+static uint32_t
+gmlgpio_intr_to_rxevcfg(uint32_t intr)
+{
+	switch (intr) {
+	case GPIO_INTR_LEVEL_LOW:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_LEVEL |
+		    GML_GPIO_PAD_CFG_DW0_RXINV);
+	case GPIO_INTR_LEVEL_HIGH:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_LEVEL);
+	case GPIO_INTR_EDGE_RISING:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_EDGE);
+	case GPIO_INTR_EDGE_FALLING:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_EDGE |
+		    GML_GPIO_PAD_CFG_DW0_RXINV);
+	case GPIO_INTR_EDGE_BOTH:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_RISE_FALL);
+	default:
+		return (GML_GPIO_PAD_CFG_DW0_RXEVCFG_LEVEL);
+	}
+}
+
+static uint32_t
+gmlgpio_rxevcfg_to_intr(uint32_t val)
+{
+	bool inv;
+
+	inv = (val & GML_GPIO_PAD_CFG_DW0_RXINV) != 0;
+	switch (val & GML_GPIO_PAD_CFG_DW0_RXEVCFG) {
+	case GML_GPIO_PAD_CFG_DW0_RXEVCFG_LEVEL:
+		return (inv ? GPIO_INTR_LEVEL_LOW : GPIO_INTR_LEVEL_HIGH);
+	case GML_GPIO_PAD_CFG_DW0_RXEVCFG_EDGE:
+		return (inv ? GPIO_INTR_EDGE_FALLING : GPIO_INTR_EDGE_RISING);
+	case GML_GPIO_PAD_CFG_DW0_RXEVCFG_RISE_FALL:
+		return (GPIO_INTR_EDGE_BOTH);
+	default:
+		return (GPIO_INTR_NONE);
+	}
+}
+
+static void
+gmlgpio_wheel_remove(struct gmlgpio_softc *sc, int pin)
+{
+	struct gmlgpio_debounce_pin *db;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	db = &sc->sc_debounce[pin];
+	if (db->db_prev >= 0)
+		sc->sc_debounce[db->db_prev].db_next = db->db_next;
+	else
+		sc->sc_wheel[db->db_deadline % GMLGPIO_WHEEL_SLOTS] =
+		    db->db_next;
+	if (db->db_next >= 0)
+		sc->sc_debounce[db->db_next].db_prev = db->db_prev;
+	sc->sc_debounce_armed[pin / 32] &= ~gmlgpio_gpi_bit(pin);
+	sc->sc_wheel_count--;
+}
+
+static void
+gmlgpio_wheel_schedule(struct gmlgpio_softc *sc, uint64_t tick)
+{
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	sc->sc_wheel_next = tick;
+	callout_reset_sbt(&sc->sc_wheel_callout, tick * GMLGPIO_WHEEL_TICK, 0,
+	    gmlgpio_wheel_run, sc, C_ABSOLUTE);
+}
+
+/*
+ * (Re)start the settle time of a pin that just saw an edge.  The interval
+ * is that of the change away from the last reported level, plus a tick
+ * since the edge may have come at any point of the current one.
+ */
+static void
+gmlgpio_wheel_arm(struct gmlgpio_softc *sc, int pin, sbintime_t now)
+{
+	struct gmlgpio_debounce_pin *db;
+	uint64_t tick;
+	int slot;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	db = &sc->sc_debounce[pin];
+	if (sc->sc_debounce_armed[pin / 32] & gmlgpio_gpi_bit(pin))
+		gmlgpio_wheel_remove(sc, pin);
+
+	tick = now / GMLGPIO_WHEEL_TICK;
+	if (sc->sc_wheel_count == 0)
+		sc->sc_wheel_tick = tick + 1;
+	db->db_deadline = tick + 1 +
+	    ((sc->sc_state[pin / 32] & gmlgpio_gpi_bit(pin)) ?
+	    db->db_fall : db->db_rise);
+	if (sc->sc_wheel_count == 0 || db->db_deadline < sc->sc_wheel_next)
+		gmlgpio_wheel_schedule(sc, db->db_deadline);
+
+	slot = db->db_deadline % GMLGPIO_WHEEL_SLOTS;
+	db->db_prev = -1;
+	db->db_next = sc->sc_wheel[slot];
+	if (db->db_next >= 0)
+		sc->sc_debounce[db->db_next].db_prev = pin;
+	sc->sc_wheel[slot] = pin;
+	sc->sc_debounce_armed[pin / 32] |= gmlgpio_gpi_bit(pin);
+	sc->sc_wheel_count++;
+}
+
+/* Stop debouncing a pin, reporting its current level */
+static void
+gmlgpio_debounce_cancel(struct gmlgpio_softc *sc, int pin)
+{
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	if ((sc->sc_debounce_mask[pin / 32] & gmlgpio_gpi_bit(pin)) == 0)
+		return;
+	sc->sc_debounce_mask[pin / 32] &= ~gmlgpio_gpi_bit(pin);
+	sc->sc_debounce[pin].db_rise = 0;
+	sc->sc_debounce[pin].db_fall = 0;
+	if (sc->sc_debounce_armed[pin / 32] & gmlgpio_gpi_bit(pin)) {
+		gmlgpio_wheel_remove(sc, pin);
+		gmlgpio_track(sc, pin,
+		    gmlgpio_pad_value(gmlgpio_read_pad_cfg_dw0(sc, pin)));
+	}
+}
+
+/*
+ * Write a pad's DW0 with a new interrupt mode.  The interrupt is masked
+ * while the event configuration changes, and anything latched under the
+ * old configuration is acked before it is unmasked.  With GPIO_INTR_NONE
+ * the event configuration is left alone and the interrupt stays masked.
+ */
+static void
+gmlgpio_set_intr_mode(struct gmlgpio_softc *sc, int pin, uint32_t val,
+    uint32_t intr)
+{
+	bus_size_t ie_offset;
+	uint32_t ie;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	ie_offset = GML_GPI_IE_0 + gmlgpio_gpi_offset(pin);
+	ie = bus_read_4(sc->sc_mem_res, ie_offset) & ~gmlgpio_gpi_bit(pin);
+	bus_write_4(sc->sc_mem_res, ie_offset, ie);
+
+	/* An explicit reconfiguration ends any storm backoff */
+	sc->sc_storm_masked[pin / 32] &= ~gmlgpio_gpi_bit(pin);
+	sc->sc_storm[pin].st_count = 0;
+	sc->sc_storm[pin].st_backoff = 0;
+
+	/* Debouncing needs an interrupt on every change of level */
+	if (intr != GPIO_INTR_EDGE_BOTH)
+		gmlgpio_debounce_cancel(sc, pin);
+
+	if (intr != GPIO_INTR_NONE) {
+		val &= ~(GML_GPIO_PAD_CFG_DW0_RXEVCFG |
+		    GML_GPIO_PAD_CFG_DW0_RXINV);
+		val |= gmlgpio_intr_to_rxevcfg(intr);
+	}
+	gmlgpio_write_pad_cfg_dw0(sc, pin, val);
+
+	if (intr != GPIO_INTR_NONE) {
+		gmlgpio_write_gpi_is(sc, gmlgpio_gpi_offset(pin),
+		    gmlgpio_gpi_bit(pin));
+		bus_write_4(sc->sc_mem_res, ie_offset,
+		    ie | gmlgpio_gpi_bit(pin));
+	}
+}
+
 static int
 gmlgpio_pin_getflags(device_t dev, uint32_t pin, uint32_t *flags)
 {
@@ -225,6 +807,11 @@ gmlgpio_pin_getflags(device_t dev, uint32_t pin, uint32_t *flags)
 	if (!(val & GML_GPIO_PAD_CFG_DW0_GPIORXDIS))
 		*flags |= GPIO_PIN_INPUT;
 
+	/* Interrupt mode is only meaningful while the pad's GPI_IE bit is set */
+	if (bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + gmlgpio_gpi_offset(pin)) &
+	    gmlgpio_gpi_bit(pin))
+		*flags |= gmlgpio_rxevcfg_to_intr(val);
+
 	GMLGPIO_UNLOCK(sc);
 	return (0);
 }
@@ -234,6 +821,7 @@ gmlgpio_pin_setflags(device_t dev, uint32_t pin, uint32_t flags)
 {
 	struct gmlgpio_softc *sc;
 	uint32_t val;
+	uint32_t intr;
 	uint32_t allowed;
 
 	sc = device_get_softc(dev);
@@ -243,11 +831,22 @@ gmlgpio_pin_setflags(device_t dev, uint32_t pin, uint32_t flags)
 	allowed = GPIO_PIN_INPUT | GPIO_PIN_OUTPUT;
 
 	/*
-	 * Only direction flag allowed
+	 * Only direction and interrupt mode flags allowed
 	 */
-	if (flags & ~allowed)
+	if (flags & ~(allowed | GPIO_INTR_MASK))
 		return (EINVAL);
 
+	/*
+	 * At most one interrupt mode, and it needs the receive path enabled
+	 */
+	intr = flags & GPIO_INTR_MASK;
+	if (intr != GPIO_INTR_NONE) {
+		if (!powerof2(intr))
+			return (EINVAL);
+		if (!(flags & GPIO_PIN_INPUT))
+			return (EINVAL);
+	}
+
 	/*
 	 * The hardware supports bidirectional mode, but gpiobus.c prohibits it.
 	 * We support it here but it cannot be activated without changing
@@ -263,6 +862,19 @@ gmlgpio_pin_setflags(device_t dev, uint32_t pin, uint32_t flags)
 
 	/* Set the GPIO mode and state */
 	GMLGPIO_LOCK(sc);
+
+	/*
+	 * Pins owned by a kernel subscriber keep their interrupt mode, and
+	 * the PPS pin is not reconfigured at all
+	 */
+	if ((int)pin == sc->sc_pps_pin ||
+	    (sc->sc_handlers[pin].ih_fn != NULL &&
+	    (intr != sc->sc_handlers[pin].ih_mode ||
+	    !(flags & GPIO_PIN_INPUT)))) {
+		GMLGPIO_UNLOCK(sc);
+		return (EBUSY);
+	}
+
 	val = gmlgpio_read_pad_cfg_dw0(sc, pin);
 	if (flags & GPIO_PIN_INPUT)
 		val &= ~GML_GPIO_PAD_CFG_DW0_GPIORXDIS;
@@ -272,7 +884,8 @@ gmlgpio_pin_setflags(device_t dev, uint32_t pin, uint32_t flags)
 		val &= ~GML_GPIO_PAD_CFG_DW0_GPIOTXDIS;
 	else
 		val |= GML_GPIO_PAD_CFG_DW0_GPIOTXDIS;
-	gmlgpio_write_pad_cfg_dw0(sc, pin, val);
+	gmlgpio_set_intr_mode(sc, pin, val, intr);
+	gmlgpio_track(sc, pin, gmlgpio_pad_value(val));
 	GMLGPIO_UNLOCK(sc);
 
 	return (0);
@@ -301,6 +914,8 @@ gmlgpio_pin_set(device_t dev, uint32_t pin, unsigned int value)
 	else
 		val |= GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
 	gmlgpio_write_pad_cfg_dw0(sc, pin, val);
+	gmlgpio_track(sc, pin, value == GPIO_PIN_LOW ?
+	    GPIO_PIN_LOW : GPIO_PIN_HIGH);
 
 	GMLGPIO_UNLOCK(sc);
 
@@ -317,23 +932,9 @@ gmlgpio_pin_get(device_t dev, uint32_t pin, unsigned int *value)
 	if (gmlgpio_valid_pin(sc, pin) != 0)
 		return (EINVAL);
 
-	/*
-	 * Read pin value:
-	 * If RXDIS is not set, read RXSTATE.
-	 * If RXDIS is set, read TXSTATE.
-	 */
 	GMLGPIO_LOCK(sc);
 	val = gmlgpio_read_pad_cfg_dw0(sc, pin);
-	if (!(val & GML_GPIO_PAD_CFG_DW0_GPIORXDIS))
-		if (val & GML_GPIO_PAD_CFG_DW0_GPIORXSTATE)
-			*value = GPIO_PIN_HIGH;
-		else
-			*value = GPIO_PIN_LOW;
-	else
-		if (val & GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE)
-			*value = GPIO_PIN_HIGH;
-		else
-			*value = GPIO_PIN_LOW;
+	*value = gmlgpio_pad_value(val);
 	GMLGPIO_UNLOCK(sc);
 
 	return (0);
@@ -360,85 +961,1418 @@ gmlgpio_pin_toggle(device_t dev, uint32_t pin)
 	/* Toggle the pin */
 	val = val ^ GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
 	gmlgpio_write_pad_cfg_dw0(sc, pin, val);
+	gmlgpio_track(sc, pin, (val & GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE) ?
+	    GPIO_PIN_HIGH : GPIO_PIN_LOW);
 
 	GMLGPIO_UNLOCK(sc);
 
 	return (0);
 }
 
-static char *gmlgpio_hids[] = {
-	"INT3453",
-	NULL
-};
-
+/*
+ * Sample the community.  Latches of pads without interrupts enabled are
+ * consumed here; those with interrupts enabled belong to gmlgpio_intr.
+ */
 static int
-gmlgpio_probe(device_t dev)
+gmlgpio_snapshot(struct gmlgpio_softc *sc, struct gmlgpio_snapshot *gs)
 {
-	int rv;
-    
-	if (acpi_disabled("gmlgpio"))
-		return (ENXIO);
-	rv = ACPI_ID_PROBE(device_get_parent(dev), dev, gmlgpio_hids, NULL);
-	if (rv <= 0)
-		device_set_desc(dev, "Intel Gemini Lake GPIO");
-	return (rv);
+	uint64_t since;
+	uint32_t latched;
+	bus_size_t offset;
+	int pin;
+	int word;
+
+	since = gs->gs_generation;
+	memset(gs, 0, sizeof(*gs));
+
+	GMLGPIO_LOCK(sc);
+	for (word = 0; word < howmany(sc->sc_npins, 32); word++) {
+		offset = 4 * word;
+		latched = gmlgpio_read_gpi_is(sc, offset) &
+		    ~bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + offset);
+		if (latched == 0)
+			continue;
+		gmlgpio_write_gpi_is(sc, offset, latched);
+		gmlgpio_track_latched(sc, word, latched);
+	}
+
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		if (since == 0)
+			gmlgpio_track(sc, pin, gmlgpio_pad_value(
+			    gmlgpio_read_pad_cfg_dw0(sc, pin)));
+		else if (sc->sc_pin_gen[pin] <= since)
+			continue;
+		gs->gs_changed[pin / 32] |= gmlgpio_gpi_bit(pin);
+	}
+
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++)
+		gs->gs_state[word] = sc->sc_state[word] & gs->gs_changed[word];
+	gs->gs_generation = sc->sc_gen;
+	gs->gs_npins = sc->sc_npins;
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
 }
 
 static int
-gmlgpio_attach(device_t dev)
+gmlgpio_setport(struct gmlgpio_softc *sc, struct gmlgpio_port *gp)
 {
-	struct gmlgpio_softc *sc;
-	ACPI_STATUS status;
-	int uid;
+	uint8_t used[GMLGPIO_MAXPINS];
+	int pin;
 	int i;
-	int error;
-	bus_size_t offset;
 
-	sc = device_get_softc(dev);
-	sc->sc_dev = dev;
-	sc->sc_handle = acpi_get_handle(dev);
+	if (gp->gp_width > GMLGPIO_PORT_MAXWIDTH)
+		return (EINVAL);
+	if (gp->gp_flags & ~(GMLGPIO_PORT_STROBE_LOW | GMLGPIO_PORT_LATCH_LOW))
+		return (EINVAL);
 
-	status = acpi_GetInteger(sc->sc_handle, "_UID", &uid);
-	if (ACPI_FAILURE(status)) {
-		device_printf(dev, "failed to read _UID\n");
-		return (ENXIO);
+	/* Every pad valid and used only once */
+	memset(used, 0, sizeof(used));
+	for (i = 0; i < gp->gp_width + 2; i++) {
+		if (i < gp->gp_width)
+			pin = gp->gp_data[i];
+		else if (i == gp->gp_width)
+			pin = gp->gp_strobe;
+		else
+			pin = gp->gp_latch;
+		if (i >= gp->gp_width && pin == -1)
+			continue;
+		if (gmlgpio_valid_pin(sc, pin) != 0 || used[pin])
+			return (EINVAL);
+		used[pin] = 1;
 	}
 
-	GMLGPIO_LOCK_INIT(sc);
+	GMLGPIO_LOCK(sc);
+	sc->sc_port = *gp;
+	GMLGPIO_UNLOCK(sc);
 
-	switch (uid) {
-	case NW_UID:
-		sc->sc_bank_prefix = NW_BANK_PREFIX;
-		sc->sc_pins = gml_northwest_pins;
-		sc->sc_pin_names = gml_northwest_pin_names;
-		break;
-	case N_UID:
-		sc->sc_bank_prefix = N_BANK_PREFIX;
-		sc->sc_pins = gml_north_pins;
-		sc->sc_pin_names = gml_north_pin_names;
-		break;
-	case AUDIO_UID:
-		sc->sc_bank_prefix = AUDIO_BANK_PREFIX;
-		sc->sc_pins = gml_audio_pins;
-		sc->sc_pin_names = gml_audio_pin_names;
-		break;
-	case SCC_UID:
-		sc->sc_bank_prefix = SCC_BANK_PREFIX;
-		sc->sc_pins = gml_scc_pins;
-		sc->sc_pin_names = gml_scc_pin_names;
-		break;
-	default:
-		device_printf(dev, "invalid _UID value: %d\n", uid);
-		return (ENXIO);
+	return (0);
+}
+
+/*
+ * Set an output pad to the given level, using and updating a cached DW0.
+ * Only writes if the level changes.
+ */
+static inline void
+gmlgpio_port_drive(struct gmlgpio_softc *sc, int pin, uint32_t *dw0, bool high)
+{
+	if (((*dw0 & GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE) != 0) == high)
+		return;
+	*dw0 ^= GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
+	gmlgpio_write_pad_cfg_dw0(sc, pin, *dw0);
+}
+
+/*
+ * Present nwords words on the data pads, strobing each one.  DW0 of every
+ * port pad is read once per call; after that each word costs one write per
+ * data bit that changed plus two for the strobe.
+ */
+static int
+gmlgpio_port_stream(struct gmlgpio_softc *sc, const struct gmlgpio_port *gp,
+    const uint8_t *buf, int nwords, int wsize)
+{
+	uint32_t dw0[GMLGPIO_PORT_MAXWIDTH];
+	uint32_t sdw0;
+	uint32_t changed;
+	uint32_t last;
+	uint32_t mask;
+	uint32_t word;
+	bool strobe_idle;
+	int i;
+	int n;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	last = 0;
+	for (i = 0; i < gp->gp_width; i++) {
+		dw0[i] = gmlgpio_read_pad_cfg_dw0(sc, gp->gp_data[i]);
+		if (dw0[i] & GML_GPIO_PAD_CFG_DW0_GPIOTXDIS)
+			return (EPERM);
+		if (dw0[i] & GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE)
+			last |= 1U << i;
 	}
 
-	for (i = 0; sc->sc_pins[i] >= 0; i++) {
-		sc->sc_npins += sc->sc_pins[i];
-		sc->sc_ngroups++;
+	sdw0 = 0;
+	strobe_idle = (gp->gp_flags & GMLGPIO_PORT_STROBE_LOW) != 0;
+	if (gp->gp_strobe != -1) {
+		sdw0 = gmlgpio_read_pad_cfg_dw0(sc, gp->gp_strobe);
+		if (sdw0 & GML_GPIO_PAD_CFG_DW0_GPIOTXDIS)
+			return (EPERM);
+		gmlgpio_port_drive(sc, gp->gp_strobe, &sdw0, strobe_idle);
 	}
 
-	sc->sc_mem_rid = 0;
-	sc->sc_mem_res = bus_alloc_resource_any(sc->sc_dev, SYS_RES_MEMORY,
+	mask = (1U << gp->gp_width) - 1;
+	for (n = 0; n < nwords; n++) {
+		if (wsize == 2)
+			word = le16dec(buf + 2 * n);
+		else
+			word = buf[n];
+		word &= mask;
+
+		changed = word ^ last;
+		for (i = 0; changed != 0; i++, changed >>= 1) {
+			if ((changed & 1) == 0)
+				continue;
+			dw0[i] ^= GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
+			gmlgpio_write_pad_cfg_dw0(sc, gp->gp_data[i], dw0[i]);
+		}
+		last = word;
+
+		if (gp->gp_strobe != -1) {
+			gmlgpio_port_drive(sc, gp->gp_strobe, &sdw0,
+			    !strobe_idle);
+			gmlgpio_port_drive(sc, gp->gp_strobe, &sdw0,
+			    strobe_idle);
+		}
+	}
+
+	for (i = 0; i < gp->gp_width; i++)
+		gmlgpio_track(sc, gp->gp_data[i],
+		    (last & (1U << i)) ? GPIO_PIN_HIGH : GPIO_PIN_LOW);
+
+	return (0);
+}
+
+static int
+gmlgpio_port_latch(struct gmlgpio_softc *sc, const struct gmlgpio_port *gp)
+{
+	uint32_t dw0;
+	bool idle;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	dw0 = gmlgpio_read_pad_cfg_dw0(sc, gp->gp_latch);
+	if (dw0 & GML_GPIO_PAD_CFG_DW0_GPIOTXDIS)
+		return (EPERM);
+	idle = (gp->gp_flags & GMLGPIO_PORT_LATCH_LOW) != 0;
+	gmlgpio_port_drive(sc, gp->gp_latch, &dw0, idle);
+	gmlgpio_port_drive(sc, gp->gp_latch, &dw0, !idle);
+	gmlgpio_port_drive(sc, gp->gp_latch, &dw0, idle);
+
+	return (0);
+}
+
+static int
+gmlgpio_write(struct cdev *cdev, struct uio *uio, int ioflag)
+{
+	struct gmlgpio_softc *sc;
+	struct gmlgpio_port gp;
+	uint8_t buf[GMLGPIO_PORT_CHUNK];
+	sbintime_t start;
+	sbintime_t elapsed;
+	uint64_t nwords;
+	int wsize;
+	int len;
+	int error;
+
+	sc = cdev->si_drv1;
+
+	GMLGPIO_LOCK(sc);
+	gp = sc->sc_port;
+	GMLGPIO_UNLOCK(sc);
+
+	if (gp.gp_width == 0)
+		return (ENXIO);
+	wsize = gp.gp_width > 8 ? 2 : 1;
+	if (uio->uio_resid % wsize != 0)
+		return (EINVAL);
+
+	error = 0;
+	nwords = 0;
+	start = sbinuptime();
+	while (uio->uio_resid > 0) {
+		len = MIN(uio->uio_resid, sizeof(buf));
+		error = uiomove(buf, len, uio);
+		if (error != 0)
+			break;
+		GMLGPIO_LOCK(sc);
+		error = gmlgpio_port_stream(sc, &gp, buf, len / wsize, wsize);
+		GMLGPIO_UNLOCK(sc);
+		if (error != 0)
+			break;
+		nwords += len / wsize;
+	}
+	elapsed = sbinuptime() - start;
+
+	GMLGPIO_LOCK(sc);
+	if (error == 0 && gp.gp_latch != -1)
+		error = gmlgpio_port_latch(sc, &gp);
+	sc->sc_port_words += nwords;
+	if (nwords != 0 && elapsed > 0)
+		sc->sc_port_rate = nwords * SBT_1S / elapsed;
+	GMLGPIO_UNLOCK(sc);
+
+	return (error);
+}
+
+static int
+gmlgpio_batch(struct gmlgpio_softc *sc, struct gmlgpio_batch *gb)
+{
+	struct gmlgpio_op *ops;
+	struct gmlgpio_op *op;
+	unsigned int value;
+	int error;
+	int i;
+
+	if (gb->gb_count > GMLGPIO_MAXBATCH)
+		return (EINVAL);
+	if (gb->gb_count == 0)
+		return (0);
+
+	ops = malloc(gb->gb_count * sizeof(*ops), M_GMLGPIO, M_WAITOK);
+	error = copyin(gb->gb_ops, ops, gb->gb_count * sizeof(*ops));
+	if (error != 0)
+		goto out;
+
+	for (i = 0; i < gb->gb_count; i++) {
+		op = &ops[i];
+		switch (op->go_op) {
+		case GMLGPIO_OP_GET:
+			op->go_error = gmlgpio_pin_get(sc->sc_dev, op->go_pin,
+			    &value);
+			op->go_value = value;
+			break;
+		case GMLGPIO_OP_SET:
+			op->go_error = gmlgpio_pin_set(sc->sc_dev, op->go_pin,
+			    op->go_value);
+			break;
+		case GMLGPIO_OP_TOGGLE:
+			op->go_error = gmlgpio_pin_toggle(sc->sc_dev,
+			    op->go_pin);
+			break;
+		case GMLGPIO_OP_GETFLAGS:
+			op->go_error = gmlgpio_pin_getflags(sc->sc_dev,
+			    op->go_pin, &op->go_value);
+			break;
+		case GMLGPIO_OP_SETFLAGS:
+			op->go_error = gmlgpio_pin_setflags(sc->sc_dev,
+			    op->go_pin, op->go_value);
+			break;
+		default:
+			op->go_error = EINVAL;
+			break;
+		}
+	}
+
+	error = copyout(ops, gb->gb_ops, gb->gb_count * sizeof(*ops));
+out:
+	free(ops, M_GMLGPIO);
+	return (error);
+}
+
+static int
+gmlgpio_pinnames(struct gmlgpio_softc *sc, struct gmlgpio_pinnames *gn)
+{
+	char name[GPIOMAXNAME];
+	int error;
+	int pin;
+
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		gmlgpio_pin_getname(sc->sc_dev, pin, name);
+		error = copyout(name, gn->gn_names[pin], sizeof(name));
+		if (error != 0)
+			return (error);
+	}
+	gn->gn_npins = sc->sc_npins;
+
+	return (0);
+}
+
+static void
+gmlgpio_sched_arm(struct gmlgpio_softc *sc)
+{
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	if (sc->sc_nsched == 0)
+		return;
+	callout_reset_sbt(&sc->sc_sched_callout,
+	    sc->sc_sched[sc->sc_nsched - 1].se_when,
+	    nstosbt(sc->sc_sched_tolerance), gmlgpio_sched_run, sc,
+	    C_ABSOLUTE | C_DIRECT_EXEC);
+}
+
+/*
+ * Callout for timed events.  Runs directly from the timer interrupt and
+ * writes every event due within the tolerance window.
+ */
+static void
+gmlgpio_sched_run(void *arg)
+{
+	struct gmlgpio_softc *sc = arg;
+	struct gmlgpio_sched_event *se;
+	sbintime_t now;
+	sbintime_t horizon;
+	uint64_t late;
+	uint64_t early;
+	uint32_t val;
+
+	now = sbinuptime();
+
+	GMLGPIO_LOCK(sc);
+	horizon = now + nstosbt(sc->sc_sched_tolerance);
+	while (sc->sc_nsched > 0) {
+		se = &sc->sc_sched[sc->sc_nsched - 1];
+		if (se->se_when > horizon)
+			break;
+		sc->sc_nsched--;
+
+		val = gmlgpio_read_pad_cfg_dw0(sc, se->se_pin);
+		if (val & GML_GPIO_PAD_CFG_DW0_GPIOTXDIS) {
+			sc->sc_sched_errors++;
+			continue;
+		}
+		if (se->se_value == GPIO_PIN_LOW)
+			val &= ~GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
+		else
+			val |= GML_GPIO_PAD_CFG_DW0_GPIOTXSTATE;
+		gmlgpio_write_pad_cfg_dw0(sc, se->se_pin, val);
+		gmlgpio_track(sc, se->se_pin, se->se_value == GPIO_PIN_LOW ?
+		    GPIO_PIN_LOW : GPIO_PIN_HIGH);
+
+		/* Events pulled forward within the tolerance count as early */
+		late = now > se->se_when ? sbttons(now - se->se_when) : 0;
+		early = now < se->se_when ? sbttons(se->se_when - now) : 0;
+		sc->sc_sched_events++;
+		sc->sc_sched_late_sum += late;
+		if (late > sc->sc_sched_late_max)
+			sc->sc_sched_late_max = late;
+		sc->sc_sched_early_sum += early;
+		if (early > sc->sc_sched_early_max)
+			sc->sc_sched_early_max = early;
+	}
+	gmlgpio_sched_arm(sc);
+	GMLGPIO_UNLOCK(sc);
+}
+
+static int
+gmlgpio_schedule(struct gmlgpio_softc *sc, struct gmlgpio_schedule *gs)
+{
+	struct gmlgpio_event *events;
+	struct gmlgpio_sched_event se;
+	int error;
+	int i;
+	int j;
+
+	if (gs->gs_count == 0)
+		return (0);
+	if (gs->gs_count > GMLGPIO_MAXEVENTS)
+		return (ENOSPC);
+
+	events = malloc(gs->gs_count * sizeof(*events), M_GMLGPIO, M_WAITOK);
+	error = copyin(gs->gs_events, events, gs->gs_count * sizeof(*events));
+	if (error != 0)
+		goto out;
+	for (i = 0; i < gs->gs_count; i++) {
+		/* Deadlines must fit in a 32.32 sbintime_t */
+		if (gmlgpio_valid_pin(sc, events[i].ge_pin) != 0 ||
+		    events[i].ge_when > (uint64_t)sbttons(SBT_MAX)) {
+			error = EINVAL;
+			goto out;
+		}
+	}
+
+	GMLGPIO_LOCK(sc);
+	if (sc->sc_nsched + gs->gs_count > GMLGPIO_MAXEVENTS) {
+		GMLGPIO_UNLOCK(sc);
+		error = ENOSPC;
+		goto out;
+	}
+	for (i = 0; i < gs->gs_count; i++) {
+		se.se_when = nstosbt(events[i].ge_when);
+		se.se_pin = events[i].ge_pin;
+		se.se_value = events[i].ge_value;
+
+		/* Insert after anything due later, so equal times run FIFO */
+		for (j = sc->sc_nsched; j > 0; j--) {
+			if (sc->sc_sched[j - 1].se_when > se.se_when)
+				break;
+			sc->sc_sched[j] = sc->sc_sched[j - 1];
+		}
+		sc->sc_sched[j] = se;
+		sc->sc_nsched++;
+	}
+	gmlgpio_sched_arm(sc);
+	GMLGPIO_UNLOCK(sc);
+
+out:
+	free(events, M_GMLGPIO);
+	return (error);
+}
+
+static int
+gmlgpio_sched_tolerance_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct gmlgpio_softc *sc = arg1;
+	uint64_t tolerance;
+	int error;
+
+	tolerance = sc->sc_sched_tolerance;
+	error = sysctl_handle_64(oidp, &tolerance, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+	if (tolerance > GMLGPIO_SCHED_TOLERANCE_MAX)
+		return (EINVAL);
+
+	GMLGPIO_LOCK(sc);
+	sc->sc_sched_tolerance = tolerance;
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+/*
+ * Program the PPS pin to interrupt on the edges being captured.  The
+ * assert edge is the rising edge.
+ */
+static void
+gmlgpio_pps_program(struct gmlgpio_softc *sc)
+{
+	uint32_t val;
+	uint32_t intr;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	switch (sc->sc_pps.ppsparam.mode & PPS_CAPTUREBOTH) {
+	case PPS_CAPTUREASSERT:
+		intr = GPIO_INTR_EDGE_RISING;
+		break;
+	case PPS_CAPTURECLEAR:
+		intr = GPIO_INTR_EDGE_FALLING;
+		break;
+	case PPS_CAPTUREBOTH:
+		intr = GPIO_INTR_EDGE_BOTH;
+		break;
+	default:
+		intr = GPIO_INTR_NONE;
+		break;
+	}
+
+	val = gmlgpio_read_pad_cfg_dw0(sc, sc->sc_pps_pin);
+	val &= ~GML_GPIO_PAD_CFG_DW0_GPIORXDIS;
+	val |= GML_GPIO_PAD_CFG_DW0_GPIOTXDIS;
+	gmlgpio_set_intr_mode(sc, sc->sc_pps_pin, val, intr);
+}
+
+/* RFC 2783 ioctls, available once a PPS pin has been selected */
+static int
+gmlgpio_pps_ioctl(struct gmlgpio_softc *sc, u_long cmd, caddr_t data)
+{
+	int error;
+
+	GMLGPIO_LOCK(sc);
+	if (sc->sc_pps_pin < 0) {
+		GMLGPIO_UNLOCK(sc);
+		return (ENOTTY);
+	}
+	error = pps_ioctl(cmd, data, &sc->sc_pps);
+	if (error == 0 && cmd == PPS_IOC_SETPARAMS)
+		gmlgpio_pps_program(sc);
+	GMLGPIO_UNLOCK(sc);
+
+	return (error == ENOIOCTL ? ENOTTY : error);
+}
+
+static int
+gmlgpio_pps_pin_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct gmlgpio_softc *sc = arg1;
+	int error;
+	int pin;
+
+	pin = sc->sc_pps_pin;
+	error = sysctl_handle_int(oidp, &pin, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+	if (pin < -1 || (pin >= 0 && gmlgpio_valid_pin(sc, pin) != 0))
+		return (EINVAL);
+
+	GMLGPIO_LOCK(sc);
+	if (pin >= 0 && pin != sc->sc_pps_pin &&
+	    sc->sc_handlers[pin].ih_fn != NULL) {
+		GMLGPIO_UNLOCK(sc);
+		return (EBUSY);
+	}
+	if (sc->sc_pps_pin >= 0)
+		gmlgpio_set_intr_mode(sc, sc->sc_pps_pin,
+		    gmlgpio_read_pad_cfg_dw0(sc, sc->sc_pps_pin),
+		    GPIO_INTR_NONE);
+	sc->sc_pps_pin = pin;
+	if (pin >= 0)
+		gmlgpio_pps_program(sc);
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+static void
+gmlgpio_getconfig(struct gmlgpio_softc *sc, struct gmlgpio_config *gc)
+{
+	int pin;
+
+	memset(gc, 0, sizeof(*gc));
+	gc->gc_version = GMLGPIO_CONFIG_VERSION;
+	gc->gc_uid = sc->sc_uid;
+	gc->gc_npins = sc->sc_npins;
+
+	GMLGPIO_LOCK(sc);
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		gc->gc_dw0[pin] = gmlgpio_read_pad_cfg_dw0(sc, pin);
+		gc->gc_dw1[pin] = gmlgpio_read_pad_cfg_dw1(sc, pin);
+	}
+	GMLGPIO_UNLOCK(sc);
+}
+
+/*
+ * Apply a configuration exported by gmlgpio_getconfig().  The hardware is
+ * read once to find the differing pads, which are all checked before any
+ * of them is written.  Pads whose receive event configuration changes go
+ * through gmlgpio_set_intr_mode(), so an enabled interrupt is masked and
+ * acked around the change and storm and debounce state are reset.
+ */
+static int
+gmlgpio_setconfig(struct gmlgpio_softc *sc, struct gmlgpio_config *gc)
+{
+	uint32_t dw0[GMLGPIO_MAXPINS];
+	uint32_t dw1[GMLGPIO_MAXPINS];
+	uint32_t differ[GMLGPIO_MAPWORDS];
+	uint32_t evmask;
+	uint32_t intr;
+	uint32_t bit;
+	int pin;
+
+	if (gc->gc_version != GMLGPIO_CONFIG_VERSION ||
+	    gc->gc_uid != (uint32_t)sc->sc_uid ||
+	    gc->gc_npins != (uint32_t)sc->sc_npins)
+		return (EINVAL);
+
+	gc->gc_written = 0;
+	memset(differ, 0, sizeof(differ));
+
+	GMLGPIO_LOCK(sc);
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		dw0[pin] = gmlgpio_read_pad_cfg_dw0(sc, pin);
+		dw1[pin] = gmlgpio_read_pad_cfg_dw1(sc, pin);
+		if (((dw0[pin] ^ gc->gc_dw0[pin]) &
+		    ~GML_GPIO_PAD_CFG_DW0_GPIORXSTATE) == 0 &&
+		    dw1[pin] == gc->gc_dw1[pin])
+			continue;
+		if (sc->sc_handlers[pin].ih_fn != NULL ||
+		    pin == sc->sc_pps_pin) {
+			GMLGPIO_UNLOCK(sc);
+			return (EBUSY);
+		}
+		differ[pin / 32] |= gmlgpio_gpi_bit(pin);
+	}
+
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		if ((differ[pin / 32] & gmlgpio_gpi_bit(pin)) == 0)
+			continue;
+		if (dw1[pin] != gc->gc_dw1[pin])
+			gmlgpio_write_pad_cfg_dw1(sc, pin, gc->gc_dw1[pin]);
+		if (((dw0[pin] ^ gc->gc_dw0[pin]) &
+		    ~GML_GPIO_PAD_CFG_DW0_GPIORXSTATE) == 0) {
+			gc->gc_written++;
+			continue;
+		}
+
+		evmask = GML_GPIO_PAD_CFG_DW0_RXEVCFG |
+		    GML_GPIO_PAD_CFG_DW0_RXINV;
+		bit = gmlgpio_gpi_bit(pin);
+		if (((dw0[pin] ^ gc->gc_dw0[pin]) & evmask) != 0) {
+			/* Keep the interrupt enabled if it was, or backing off */
+			intr = GPIO_INTR_NONE;
+			if ((bus_read_4(sc->sc_mem_res,
+			    GML_GPI_IE_0 + gmlgpio_gpi_offset(pin)) & bit) ||
+			    (sc->sc_storm_masked[pin / 32] & bit))
+				intr = gmlgpio_rxevcfg_to_intr(gc->gc_dw0[pin]);
+			gmlgpio_set_intr_mode(sc, pin, gc->gc_dw0[pin], intr);
+		} else
+			gmlgpio_write_pad_cfg_dw0(sc, pin, gc->gc_dw0[pin]);
+
+		/* The exported RX state is stale, read back the pad's own */
+		gmlgpio_track(sc, pin,
+		    gmlgpio_pad_value(gmlgpio_read_pad_cfg_dw0(sc, pin)));
+		gc->gc_written++;
+	}
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+gmlgpio_setdebounce(struct gmlgpio_softc *sc, struct gmlgpio_debounce *gd)
+{
+	uint32_t intr;
+
+	if (gmlgpio_valid_pin(sc, gd->gd_pin) != 0)
+		return (EINVAL);
+
+	GMLGPIO_LOCK(sc);
+	if (gd->gd_pin == sc->sc_pps_pin) {
+		GMLGPIO_UNLOCK(sc);
+		return (EBUSY);
+	}
+	if (gd->gd_rise_ms == 0 && gd->gd_fall_ms == 0) {
+		gmlgpio_debounce_cancel(sc, gd->gd_pin);
+		GMLGPIO_UNLOCK(sc);
+		return (0);
+	}
+
+	/*
+	 * The pin must already be interrupting on both edges: with a single
+	 * edge, a return to the old level within the settle time raises no
+	 * interrupt and the change it cancels would go unnoticed.
+	 */
+	intr = GPIO_INTR_NONE;
+	if (bus_read_4(sc->sc_mem_res,
+	    GML_GPI_IE_0 + gmlgpio_gpi_offset(gd->gd_pin)) &
+	    gmlgpio_gpi_bit(gd->gd_pin))
+		intr = gmlgpio_rxevcfg_to_intr(
+		    gmlgpio_read_pad_cfg_dw0(sc, gd->gd_pin));
+	if (intr != GPIO_INTR_EDGE_BOTH) {
+		GMLGPIO_UNLOCK(sc);
+		return (EINVAL);
+	}
+
+	sc->sc_debounce[gd->gd_pin].db_rise = gd->gd_rise_ms;
+	sc->sc_debounce[gd->gd_pin].db_fall = gd->gd_fall_ms;
+	sc->sc_debounce_mask[gd->gd_pin / 32] |= gmlgpio_gpi_bit(gd->gd_pin);
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+static int
+gmlgpio_getdebounce(struct gmlgpio_softc *sc, struct gmlgpio_debounce *gd)
+{
+	if (gmlgpio_valid_pin(sc, gd->gd_pin) != 0)
+		return (EINVAL);
+
+	GMLGPIO_LOCK(sc);
+	gd->gd_rise_ms = sc->sc_debounce[gd->gd_pin].db_rise;
+	gd->gd_fall_ms = sc->sc_debounce[gd->gd_pin].db_fall;
+	gd->gd_pad = 0;
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+#ifdef GMLGPIO_MMIO_STATS
+/* One line per non-empty bucket: upper bound in TSC ticks, and count */
+static int
+gmlgpio_mmio_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct gmlgpio_softc *sc = arg1;
+	struct sbuf sb;
+	uint64_t count;
+	int bucket;
+	int error;
+
+	sbuf_new_for_sysctl(&sb, NULL, 128, req);
+	for (bucket = 0; bucket < GMLGPIO_MMIO_BUCKETS; bucket++) {
+		count = sc->sc_mmio_hist[arg2][bucket];
+		if (count == 0)
+			continue;
+		if (bucket == GMLGPIO_MMIO_BUCKETS - 1)
+			sbuf_printf(&sb, "\n   inf %ju", (uintmax_t)count);
+		else
+			sbuf_printf(&sb, "\n%6ju %ju",
+			    (uintmax_t)1 << bucket, (uintmax_t)count);
+	}
+	error = sbuf_finish(&sb);
+	sbuf_delete(&sb);
+
+	return (error);
+}
+#endif
+
+static int
+gmlgpio_ioctl(struct cdev *cdev, u_long cmd, caddr_t data, int fflag,
+    struct thread *td)
+{
+	struct gmlgpio_softc *sc;
+
+	sc = cdev->si_drv1;
+
+	switch (cmd) {
+	case GMLGPIO_SNAPSHOT:
+		return (gmlgpio_snapshot(sc, (struct gmlgpio_snapshot *)data));
+	case GMLGPIO_SETPORT:
+		return (gmlgpio_setport(sc, (struct gmlgpio_port *)data));
+	case GMLGPIO_GETPORT:
+		GMLGPIO_LOCK(sc);
+		*(struct gmlgpio_port *)data = sc->sc_port;
+		GMLGPIO_UNLOCK(sc);
+		return (0);
+	case GMLGPIO_BATCH:
+		return (gmlgpio_batch(sc, (struct gmlgpio_batch *)data));
+	case GMLGPIO_PINNAMES:
+		return (gmlgpio_pinnames(sc, (struct gmlgpio_pinnames *)data));
+	case GMLGPIO_SCHEDULE:
+		return (gmlgpio_schedule(sc, (struct gmlgpio_schedule *)data));
+	case GMLGPIO_SCHEDFLUSH:
+		GMLGPIO_LOCK(sc);
+		sc->sc_nsched = 0;
+		callout_stop(&sc->sc_sched_callout);
+		GMLGPIO_UNLOCK(sc);
+		return (0);
+	case GMLGPIO_GETCONFIG:
+		gmlgpio_getconfig(sc, (struct gmlgpio_config *)data);
+		return (0);
+	case GMLGPIO_SETCONFIG:
+		return (gmlgpio_setconfig(sc, (struct gmlgpio_config *)data));
+	case GMLGPIO_SETDEBOUNCE:
+		return (gmlgpio_setdebounce(sc, (struct gmlgpio_debounce *)data));
+	case GMLGPIO_GETDEBOUNCE:
+		return (gmlgpio_getdebounce(sc, (struct gmlgpio_debounce *)data));
+	default:
+		return (gmlgpio_pps_ioctl(sc, cmd, data));
+	}
+}
+
+int
+gmlgpio_intr_establish(device_t dev, int pin, uint32_t mode, int flags,
+    gmlgpio_intr_t *handler, void *arg)
+{
+	struct gmlgpio_softc *sc;
+	struct gmlgpio_handler *ih;
+	uint32_t val;
+	uint32_t bit;
+	int word;
+
+	sc = device_get_softc(dev);
+	if (gmlgpio_valid_pin(sc, pin) != 0 || handler == NULL)
+		return (EINVAL);
+	if (mode == GPIO_INTR_NONE || (mode & ~GPIO_INTR_MASK) != 0 ||
+	    !powerof2(mode))
+		return (EINVAL);
+	if (flags & ~GMLGPIO_INTR_FILTER)
+		return (EINVAL);
+
+	word = pin / 32;
+	bit = gmlgpio_gpi_bit(pin);
+
+	GMLGPIO_LOCK(sc);
+	ih = &sc->sc_handlers[pin];
+	if (ih->ih_fn != NULL || pin == sc->sc_pps_pin) {
+		GMLGPIO_UNLOCK(sc);
+		return (EBUSY);
+	}
+	ih->ih_arg = arg;
+	ih->ih_mode = mode;
+	ih->ih_fn = handler;
+	if (flags & GMLGPIO_INTR_FILTER)
+		sc->sc_filter_mask[word] |= bit;
+	if (mode == GPIO_INTR_LEVEL_LOW || mode == GPIO_INTR_LEVEL_HIGH)
+		sc->sc_level_mask[word] |= bit;
+
+	val = gmlgpio_read_pad_cfg_dw0(sc, pin);
+	val &= ~GML_GPIO_PAD_CFG_DW0_GPIORXDIS;
+	gmlgpio_set_intr_mode(sc, pin, val, mode);
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+int
+gmlgpio_intr_disestablish(device_t dev, int pin)
+{
+	struct gmlgpio_softc *sc;
+	struct gmlgpio_handler *ih;
+	uint32_t bit;
+	int word;
+
+	sc = device_get_softc(dev);
+	if (gmlgpio_valid_pin(sc, pin) != 0)
+		return (EINVAL);
+
+	word = pin / 32;
+	bit = gmlgpio_gpi_bit(pin);
+
+	GMLGPIO_LOCK(sc);
+	ih = &sc->sc_handlers[pin];
+	if (ih->ih_fn == NULL) {
+		GMLGPIO_UNLOCK(sc);
+		return (ENOENT);
+	}
+	gmlgpio_set_intr_mode(sc, pin, gmlgpio_read_pad_cfg_dw0(sc, pin),
+	    GPIO_INTR_NONE);
+	sc->sc_filter_mask[word] &= ~bit;
+	sc->sc_level_mask[word] &= ~bit;
+	sc->sc_thread_pending[word] &= ~bit;
+
+	/* Let a call already under way finish before it is torn down */
+	ih->ih_dying = true;
+	while (ih->ih_busy != 0) {
+		GMLGPIO_UNLOCK(sc);
+		pause("gmlgpio", 1);
+		GMLGPIO_LOCK(sc);
+	}
+	ih->ih_fn = NULL;
+	ih->ih_arg = NULL;
+	ih->ih_mode = GPIO_INTR_NONE;
+	ih->ih_dying = false;
+	GMLGPIO_UNLOCK(sc);
+
+	return (0);
+}
+
+/*
+ * GpioInt resolution for ACPI consumers
+ */
+struct gmlgpio_acpi_gpioint {
+	int		ag_index;
+	ACPI_HANDLE	ag_scope;
+	ACPI_HANDLE	ag_source;
+	int		ag_pin;
+	uint32_t	ag_mode;
+};
+
+struct gmlgpio_acpi_cookie {
+	device_t	ac_dev;
+	int		ac_pin;
+};
+
+static ACPI_STATUS
+gmlgpio_acpi_find_gpioint(ACPI_RESOURCE *res, void *context)
+{
+	struct gmlgpio_acpi_gpioint *ag = context;
+	ACPI_RESOURCE_GPIO *gpio;
+
+	if (res->Type != ACPI_RESOURCE_TYPE_GPIO)
+		return (AE_OK);
+	gpio = &res->Data.Gpio;
+	if (gpio->ConnectionType != ACPI_RESOURCE_GPIO_TYPE_INT)
+		return (AE_OK);
+	if (ag->ag_index-- != 0)
+		return (AE_OK);
+
+	if (gpio->PinTableLength < 1 || gpio->ResourceSource.StringPtr == NULL ||
+	    ACPI_FAILURE(AcpiGetHandle(ag->ag_scope,
+	    gpio->ResourceSource.StringPtr, &ag->ag_source)))
+		return (AE_NOT_FOUND);
+	ag->ag_pin = gpio->PinTable[0];
+
+	if (gpio->Polarity == ACPI_ACTIVE_BOTH)
+		ag->ag_mode = GPIO_INTR_EDGE_BOTH;
+	else if (gpio->Triggering == ACPI_LEVEL_SENSITIVE)
+		ag->ag_mode = gpio->Polarity == ACPI_ACTIVE_LOW ?
+		    GPIO_INTR_LEVEL_LOW : GPIO_INTR_LEVEL_HIGH;
+	else
+		ag->ag_mode = gpio->Polarity == ACPI_ACTIVE_LOW ?
+		    GPIO_INTR_EDGE_FALLING : GPIO_INTR_EDGE_RISING;
+
+	return (AE_CTRL_TERMINATE);
+}
+
+int
+gmlgpio_acpi_intr_establish(ACPI_HANDLE handle, int index, int flags,
+    gmlgpio_intr_t *handler, void *arg, void **cookiep)
+{
+	struct gmlgpio_acpi_gpioint ag;
+	struct gmlgpio_acpi_cookie *ac;
+	struct gmlgpio_softc *sc;
+	ACPI_STATUS status;
+	int error;
+	int i;
+
+	memset(&ag, 0, sizeof(ag));
+	ag.ag_index = index;
+	ag.ag_scope = handle;
+	status = AcpiWalkResources(handle, "_CRS", gmlgpio_acpi_find_gpioint,
+	    &ag);
+	if (ACPI_FAILURE(status) || ag.ag_source == NULL)
+		return (ENOENT);
+
+	/* The pin number is the pad index within the community */
+	sc = NULL;
+	sx_slock(&gmlgpio_communities_lock);
+	for (i = 0; i < GMLGPIO_NCOMMUNITIES; i++) {
+		if (gmlgpio_communities[i] != NULL &&
+		    gmlgpio_communities[i]->sc_handle == ag.ag_source) {
+			sc = gmlgpio_communities[i];
+			break;
+		}
+	}
+	if (sc == NULL) {
+		sx_sunlock(&gmlgpio_communities_lock);
+		return (ENXIO);
+	}
+
+	error = gmlgpio_intr_establish(sc->sc_dev, ag.ag_pin, ag.ag_mode,
+	    flags, handler, arg);
+	sx_sunlock(&gmlgpio_communities_lock);
+	if (error != 0)
+		return (error);
+
+	ac = malloc(sizeof(*ac), M_GMLGPIO, M_WAITOK);
+	ac->ac_dev = sc->sc_dev;
+	ac->ac_pin = ag.ag_pin;
+	*cookiep = ac;
+
+	return (0);
+}
+
+int
+gmlgpio_acpi_intr_disestablish(void *cookie)
+{
+	struct gmlgpio_acpi_cookie *ac = cookie;
+	int error;
+
+	error = gmlgpio_intr_disestablish(ac->ac_dev, ac->ac_pin);
+	if (error == 0)
+		free(ac, M_GMLGPIO);
+
+	return (error);
+}
+
+/*
+ * Read a set of pins spread over several communities as one sequence.
+ * Register addresses are resolved first so that only the DW0 reads run
+ * with interrupts disabled.
+ */
+static int
+gmlgpio_xsample(struct gmlgpio_xsample *gx)
+{
+	struct gmlgpio_xpin *pins;
+	struct gmlgpio_softc *sc;
+	struct resource **res;
+	bus_size_t *offsets;
+	uint32_t *dw0;
+	sbintime_t start;
+	sbintime_t end;
+	int error;
+	int i;
+	int j;
+
+	if (gx->gx_count == 0 || gx->gx_count > GMLGPIO_MAXXSAMPLE)
+		return (EINVAL);
+
+	pins = malloc(gx->gx_count * sizeof(*pins), M_GMLGPIO, M_WAITOK);
+	res = malloc(gx->gx_count * sizeof(*res), M_GMLGPIO, M_WAITOK);
+	offsets = malloc(gx->gx_count * sizeof(*offsets), M_GMLGPIO, M_WAITOK);
+	dw0 = malloc(gx->gx_count * sizeof(*dw0), M_GMLGPIO, M_WAITOK);
+
+	error = copyin(gx->gx_pins, pins, gx->gx_count * sizeof(*pins));
+	if (error != 0)
+		goto out;
+
+	sx_slock(&gmlgpio_communities_lock);
+	for (i = 0; i < gx->gx_count; i++) {
+		sc = NULL;
+		for (j = 0; j < GMLGPIO_NCOMMUNITIES; j++) {
+			if (gmlgpio_communities[j] != NULL &&
+			    device_get_unit(gmlgpio_communities[j]->sc_dev) ==
+			    pins[i].gx_unit) {
+				sc = gmlgpio_communities[j];
+				break;
+			}
+		}
+		if (sc == NULL || gmlgpio_valid_pin(sc, pins[i].gx_pin) != 0) {
+			sx_sunlock(&gmlgpio_communities_lock);
+			error = EINVAL;
+			goto out;
+		}
+		res[i] = sc->sc_mem_res;
+		offsets[i] = gmlgpio_pad_cfg_dw0_offset(sc, pins[i].gx_pin);
+	}
+
+	spinlock_enter();
+	start = sbinuptime();
+	for (i = 0; i < gx->gx_count; i++)
+		dw0[i] = bus_read_4(res[i], offsets[i]);
+	end = sbinuptime();
+	spinlock_exit();
+	sx_sunlock(&gmlgpio_communities_lock);
+
+	for (i = 0; i < gx->gx_count; i++)
+		pins[i].gx_value = gmlgpio_pad_value(dw0[i]);
+	gx->gx_timestamp = sbttons(start + (end - start) / 2);
+	gx->gx_skew = sbttons(end - start);
+
+	error = copyout(pins, gx->gx_pins, gx->gx_count * sizeof(*pins));
+out:
+	free(dw0, M_GMLGPIO);
+	free(offsets, M_GMLGPIO);
+	free(res, M_GMLGPIO);
+	free(pins, M_GMLGPIO);
+	return (error);
+}
+
+/* VCD identifiers are printable characters, base 94, one per pin */
+static void
+gmlgpio_vcd_id(struct sbuf *sb, int slot, int pin)
+{
+	int code;
+
+	code = slot * GMLGPIO_MAXPINS + pin;
+	do {
+		sbuf_putc(sb, '!' + code % 94);
+		code /= 94;
+	} while (code != 0);
+}
+
+static void
+gmlgpio_vcd_scope(struct sbuf *sb, struct gmlgpio_softc *sc)
+{
+	int pin;
+
+	sbuf_printf(sb, "$scope module %s $end\n", sc->sc_bank_prefix);
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		sbuf_printf(sb, "$var wire 1 ");
+		gmlgpio_vcd_id(sb, sc->sc_uid - 1, pin);
+		sbuf_printf(sb, " %s $end\n", sc->sc_pin_names[pin]);
+	}
+	sbuf_printf(sb, "$upscope $end\n");
+}
+
+static void
+gmlgpio_vcd_dumpvars(struct sbuf *sb, struct gmlgpio_softc *sc)
+{
+	uint32_t state[GMLGPIO_MAPWORDS];
+	int pin;
+
+	GMLGPIO_LOCK(sc);
+	memcpy(state, sc->sc_state, sizeof(state));
+	GMLGPIO_UNLOCK(sc);
+
+	for (pin = 0; pin < sc->sc_npins; pin++) {
+		sbuf_putc(sb, (state[pin / 32] & gmlgpio_gpi_bit(pin)) ?
+		    '1' : '0');
+		gmlgpio_vcd_id(sb, sc->sc_uid - 1, pin);
+		sbuf_putc(sb, '\n');
+	}
+}
+
+/*
+ * Start queueing changes, then write the header and the initial values
+ * of the community, or of every attached community for /dev/gmlgpio.vcd.
+ * A change racing with the initial values may be reported twice.
+ */
+static int
+gmlgpio_vcd_open(struct cdev *cdev, int oflags, int devtype, struct thread *td)
+{
+	struct gmlgpio_vcd *vc;
+	struct gmlgpio_softc *sc;
+	struct gmlgpio_vcd_event *ring;
+	struct sbuf *sb;
+	int i;
+
+	vc = cdev->si_drv1;
+	sc = cdev->si_drv2;
+
+	if (oflags & FWRITE)
+		return (EPERM);
+
+	sx_xlock(&vc->vc_lock);
+	if (vc->vc_out != NULL) {
+		sx_xunlock(&vc->vc_lock);
+		return (EBUSY);
+	}
+	ring = malloc(GMLGPIO_VCD_EVENTS * sizeof(*ring), M_GMLGPIO,
+	    M_WAITOK);
+	sb = sbuf_new_auto();
+
+	mtx_lock_spin(&vc->vc_mtx);
+	vc->vc_ring = ring;
+	vc->vc_head = 0;
+	vc->vc_count = 0;
+	vc->vc_dropped = 0;
+	vc->vc_gone = false;
+	vc->vc_start = sbinuptime();
+	vc->vc_active = true;
+	mtx_unlock_spin(&vc->vc_mtx);
+
+	sbuf_printf(sb, "$version gmlgpio $end\n$timescale 1 ns $end\n");
+	vc->vc_slots = 0;
+	if (sc != NULL) {
+		gmlgpio_vcd_scope(sb, sc);
+		vc->vc_slots |= 1U << (sc->sc_uid - 1);
+	} else {
+		sx_slock(&gmlgpio_communities_lock);
+		for (i = 0; i < GMLGPIO_NCOMMUNITIES; i++) {
+			if (gmlgpio_communities[i] == NULL)
+				continue;
+			gmlgpio_vcd_scope(sb, gmlgpio_communities[i]);
+			vc->vc_slots |= 1U << i;
+		}
+	}
+	sbuf_printf(sb, "$enddefinitions $end\n#0\n$dumpvars\n");
+	if (sc != NULL) {
+		gmlgpio_vcd_dumpvars(sb, sc);
+	} else {
+		for (i = 0; i < GMLGPIO_NCOMMUNITIES; i++)
+			if (gmlgpio_communities[i] != NULL)
+				gmlgpio_vcd_dumpvars(sb, gmlgpio_communities[i]);
+		sx_sunlock(&gmlgpio_communities_lock);
+	}
+	sbuf_printf(sb, "$end\n");
+	sbuf_finish(sb);
+
+	vc->vc_out = sb;
+	vc->vc_outoff = 0;
+	vc->vc_last = 0;
+	sx_xunlock(&vc->vc_lock);
+
+	return (0);
+}
+
+/* Stop queueing and free the ring; also used when the device goes away */
+static void
+gmlgpio_vcd_release(struct gmlgpio_vcd *vc)
+{
+	struct gmlgpio_vcd_event *ring;
+
+	sx_xlock(&vc->vc_lock);
+	mtx_lock_spin(&vc->vc_mtx);
+	vc->vc_active = false;
+	ring = vc->vc_ring;
+	vc->vc_ring = NULL;
+	mtx_unlock_spin(&vc->vc_mtx);
+	free(ring, M_GMLGPIO);
+	if (vc->vc_out != NULL)
+		sbuf_delete(vc->vc_out);
+	vc->vc_out = NULL;
+	sx_xunlock(&vc->vc_lock);
+}
+
+static int
+gmlgpio_vcd_close(struct cdev *cdev, int fflag, int devtype, struct thread *td)
+{
+	gmlgpio_vcd_release(cdev->si_drv1);
+	return (0);
+}
+
+/* Wake a blocked reader so destroy_dev() can finish */
+static void
+gmlgpio_vcd_purge(struct cdev *cdev)
+{
+	struct gmlgpio_vcd *vc;
+
+	vc = cdev->si_drv1;
+	mtx_lock_spin(&vc->vc_mtx);
+	vc->vc_gone = true;
+	mtx_unlock_spin(&vc->vc_mtx);
+	wakeup(vc);
+}
+
+/*
+ * Format the next batch of queued changes into vc_out, sleeping for one
+ * if wait is set.  Producers run in the interrupt filter and cannot use a
+ * sleep lock, so the sleep is bounded in case a wakeup is missed between
+ * dropping the ring lock and going to sleep.
+ */
+static int
+gmlgpio_vcd_refill(struct gmlgpio_vcd *vc, bool wait)
+{
+	struct gmlgpio_vcd_event events[GMLGPIO_VCD_CHUNK];
+	uint64_t dropped;
+	u_int n;
+	u_int i;
+	int error;
+
+	sx_assert(&vc->vc_lock, SA_XLOCKED);
+
+	mtx_lock_spin(&vc->vc_mtx);
+	while (vc->vc_count == 0 && vc->vc_dropped == 0) {
+		if (vc->vc_gone) {
+			/* Leave vc_out empty, which the reader takes as EOF */
+			mtx_unlock_spin(&vc->vc_mtx);
+			sbuf_clear(vc->vc_out);
+			sbuf_finish(vc->vc_out);
+			vc->vc_outoff = 0;
+			return (0);
+		}
+		if (!wait) {
+			mtx_unlock_spin(&vc->vc_mtx);
+			return (EWOULDBLOCK);
+		}
+		vc->vc_sleeping = true;
+		mtx_unlock_spin(&vc->vc_mtx);
+		error = tsleep(vc, PCATCH, "gmlvcd", hz / 10);
+		if (error != 0 && error != EWOULDBLOCK)
+			return (error);
+		mtx_lock_spin(&vc->vc_mtx);
+	}
+	n = MIN(vc->vc_count, GMLGPIO_VCD_CHUNK);
+	for (i = 0; i < n; i++)
+		events[i] = vc->vc_ring[(vc->vc_head + i) % GMLGPIO_VCD_EVENTS];
+	vc->vc_head = (vc->vc_head + n) % GMLGPIO_VCD_EVENTS;
+	vc->vc_count -= n;
+	dropped = vc->vc_dropped;
+	vc->vc_dropped = 0;
+	mtx_unlock_spin(&vc->vc_mtx);
+
+	sbuf_clear(vc->vc_out);
+	vc->vc_outoff = 0;
+	for (i = 0; i < n; i++) {
+		if ((vc->vc_slots & (1U << events[i].ve_slot)) == 0)
+			continue;
+		if (events[i].ve_time != vc->vc_last) {
+			vc->vc_last = events[i].ve_time;
+			sbuf_printf(vc->vc_out, "#%ju\n",
+			    (uintmax_t)vc->vc_last);
+		}
+		sbuf_putc(vc->vc_out, events[i].ve_value ? '1' : '0');
+		gmlgpio_vcd_id(vc->vc_out, events[i].ve_slot, events[i].ve_pin);
+		sbuf_putc(vc->vc_out, '\n');
+	}
+	if (dropped != 0)
+		sbuf_printf(vc->vc_out, "$comment %ju changes dropped $end\n",
+		    (uintmax_t)dropped);
+	sbuf_finish(vc->vc_out);
+
+	return (0);
+}
+
+/*
+ * Blocks until at least one change can be returned, unless opened with
+ * O_NONBLOCK.  Returns end of file once the community has detached.
+ */
+static int
+gmlgpio_vcd_read(struct cdev *cdev, struct uio *uio, int ioflag)
+{
+	struct gmlgpio_vcd *vc;
+	ssize_t start;
+	ssize_t n;
+	int error;
+
+	vc = cdev->si_drv1;
+	start = uio->uio_resid;
+	error = 0;
+
+	sx_xlock(&vc->vc_lock);
+	while (uio->uio_resid > 0) {
+		n = MIN(sbuf_len(vc->vc_out) - vc->vc_outoff, uio->uio_resid);
+		if (n > 0) {
+			error = uiomove(sbuf_data(vc->vc_out) + vc->vc_outoff,
+			    n, uio);
+			if (error != 0)
+				break;
+			vc->vc_outoff += n;
+			continue;
+		}
+		error = gmlgpio_vcd_refill(vc, uio->uio_resid == start &&
+		    (ioflag & O_NONBLOCK) == 0);
+		if (error != 0 || (sbuf_len(vc->vc_out) == 0 && vc->vc_gone))
+			break;
+	}
+	sx_xunlock(&vc->vc_lock);
+
+	/* A short read is not an error */
+	if (error == EWOULDBLOCK && uio->uio_resid != start)
+		error = 0;
+	return (error);
+}
+
+static int
+gmlgpio_all_ioctl(struct cdev *cdev, u_long cmd, caddr_t data, int fflag,
+    struct thread *td)
+{
+	switch (cmd) {
+	case GMLGPIO_XSAMPLE:
+		return (gmlgpio_xsample((struct gmlgpio_xsample *)data));
+	default:
+		return (ENOTTY);
+	}
+}
+
+static char *gmlgpio_hids[] = {
+	"INT3453",
+	NULL
+};
+
+static int
+gmlgpio_probe(device_t dev)
+{
+	int rv;
+    
+	if (acpi_disabled("gmlgpio"))
+		return (ENXIO);
+	rv = ACPI_ID_PROBE(device_get_parent(dev), dev, gmlgpio_hids, NULL);
+	if (rv <= 0)
+		device_set_desc(dev, "Intel Gemini Lake GPIO");
+	return (rv);
+}
+
+static int
+gmlgpio_attach(device_t dev)
+{
+	struct gmlgpio_softc *sc;
+	ACPI_STATUS status;
+	int uid;
+	int i;
+	int error;
+	bus_size_t offset;
+	struct make_dev_args args;
+	struct sysctl_ctx_list *ctx;
+	struct sysctl_oid_list *tree;
+#ifdef GMLGPIO_MMIO_STATS
+	struct sysctl_oid *node;
+#endif
+
+	sc = device_get_softc(dev);
+	sc->sc_dev = dev;
+	sc->sc_handle = acpi_get_handle(dev);
+
+	status = acpi_GetInteger(sc->sc_handle, "_UID", &uid);
+	if (ACPI_FAILURE(status)) {
+		device_printf(dev, "failed to read _UID\n");
+		return (ENXIO);
+	}
+
+	GMLGPIO_LOCK_INIT(sc);
+	callout_init(&sc->sc_sched_callout, 1);
+	sc->sc_sched_tolerance = GMLGPIO_SCHED_TOLERANCE;
+	callout_init(&sc->sc_storm_callout, 1);
+	sc->sc_storm_threshold = GMLGPIO_STORM_THRESHOLD;
+	callout_init(&sc->sc_wheel_callout, 1);
+	for (i = 0; i < GMLGPIO_WHEEL_SLOTS; i++)
+		sc->sc_wheel[i] = -1;
+
+	sc->sc_pps_pin = -1;
+	sc->sc_pps.ppscap = PPS_CAPTUREBOTH;
+	sc->sc_pps.driver_abi = PPS_ABI_VERSION;
+	sc->sc_pps.driver_mtx = &sc->sc_mtx;
+	sc->sc_pps.flags = PPSFLAG_MTX_SPIN;
+	pps_init_abi(&sc->sc_pps);
+
+	switch (uid) {
+	case NW_UID:
+		sc->sc_bank_prefix = NW_BANK_PREFIX;
+		sc->sc_pins = gml_northwest_pins;
+		sc->sc_pin_names = gml_northwest_pin_names;
+		break;
+	case N_UID:
+		sc->sc_bank_prefix = N_BANK_PREFIX;
+		sc->sc_pins = gml_north_pins;
+		sc->sc_pin_names = gml_north_pin_names;
+		break;
+	case AUDIO_UID:
+		sc->sc_bank_prefix = AUDIO_BANK_PREFIX;
+		sc->sc_pins = gml_audio_pins;
+		sc->sc_pin_names = gml_audio_pin_names;
+		break;
+	case SCC_UID:
+		sc->sc_bank_prefix = SCC_BANK_PREFIX;
+		sc->sc_pins = gml_scc_pins;
+		sc->sc_pin_names = gml_scc_pin_names;
+		break;
+	default:
+		device_printf(dev, "invalid _UID value: %d\n", uid);
+		return (ENXIO);
+	}
+	sc->sc_uid = uid;
+
+	for (i = 0; sc->sc_pins[i] >= 0; i++) {
+		sc->sc_npins += sc->sc_pins[i];
+		sc->sc_ngroups++;
+	}
+	KASSERT(sc->sc_npins <= GMLGPIO_MAXPINS,
+	    ("%s: too many pins", __func__));
+
+	sc->sc_mem_rid = 0;
+	sc->sc_mem_res = bus_alloc_resource_any(sc->sc_dev, SYS_RES_MEMORY,
 	    &sc->sc_mem_rid, RF_ACTIVE);
 	if (sc->sc_mem_res == NULL) {
 		GMLGPIO_LOCK_DESTROY(sc);
@@ -446,6 +2380,9 @@ gmlgpio_attach(device_t dev)
 		return (ENOMEM);
 	}
 
+	/* Get PAD base address, needed by the interrupt handler */
+	sc->sc_padbar = gmlgpio_read_padbar(sc);
+
 	sc->sc_irq_res = bus_alloc_resource_any(dev, SYS_RES_IRQ,
 	    &sc->sc_irq_rid, RF_ACTIVE | RF_SHAREABLE);
 
@@ -458,7 +2395,7 @@ gmlgpio_attach(device_t dev)
 	}
 
 	error = bus_setup_intr(sc->sc_dev, sc->sc_irq_res, INTR_TYPE_MISC | INTR_MPSAFE,
-	    NULL, gmlgpio_intr, sc, &sc->intr_handle);
+	    gmlgpio_filter, gmlgpio_intr, sc, &sc->intr_handle);
 
 
 	if (error) {
@@ -474,7 +2411,7 @@ gmlgpio_attach(device_t dev)
 	/* Mask and ack all interrupts. Smaller communities reserve unused registers. */
 	for (offset = 0; offset <= GML_GPI_IS_3 - GML_GPI_IS_0; offset += 4) {
 		bus_write_4(sc->sc_mem_res, GML_GPI_IE_0 + offset, 0);
-		bus_write_4(sc->sc_mem_res, GML_GPI_IS_0 + offset, 0xffffffff);
+		gmlgpio_write_gpi_is(sc, offset, 0xffffffff);
 	}
 
 #if __FreeBSD_version >= 1500000
@@ -493,50 +2430,539 @@ gmlgpio_attach(device_t dev)
 #if __FreeBSD_version >= 1500000
     bus_attach_children(dev);
 #endif
-	/* Get PAD base address */
-	sc->sc_padbar = gmlgpio_read_padbar(sc);
+
+	/* Seed change tracking with the current pin state */
+	GMLGPIO_LOCK(sc);
+	sc->sc_gen = 1;
+	for (i = 0; i < sc->sc_npins; i++)
+		if (gmlgpio_pad_value(gmlgpio_read_pad_cfg_dw0(sc, i)) !=
+		    GPIO_PIN_LOW)
+			sc->sc_state[i / 32] |= gmlgpio_gpi_bit(i);
+	GMLGPIO_UNLOCK(sc);
+
+	sc->sc_port.gp_strobe = -1;
+	sc->sc_port.gp_latch = -1;
+
+	ctx = device_get_sysctl_ctx(dev);
+	tree = SYSCTL_CHILDREN(device_get_sysctl_tree(dev));
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "port_words", CTLFLAG_RD,
+	    &sc->sc_port_words, 0, "Words written through the virtual port");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "port_rate", CTLFLAG_RD,
+	    &sc->sc_port_rate, 0,
+	    "Words per second achieved by the last virtual port write");
+	SYSCTL_ADD_PROC(ctx, tree, OID_AUTO, "sched_tolerance_ns",
+	    CTLTYPE_U64 | CTLFLAG_RW | CTLFLAG_MPSAFE, sc, 0,
+	    gmlgpio_sched_tolerance_sysctl, "QU",
+	    "Window within which timed events are written together, at most 1 s");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_events", CTLFLAG_RD,
+	    &sc->sc_sched_events, 0, "Timed events written");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_errors", CTLFLAG_RD,
+	    &sc->sc_sched_errors, 0,
+	    "Timed events dropped because the pin was not an output");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_late_sum_ns", CTLFLAG_RD,
+	    &sc->sc_sched_late_sum, 0,
+	    "Total lateness of timed events");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_late_max_ns", CTLFLAG_RD,
+	    &sc->sc_sched_late_max, 0,
+	    "Largest lateness of a timed event");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_early_sum_ns", CTLFLAG_RD,
+	    &sc->sc_sched_early_sum, 0,
+	    "Total earliness of timed events written ahead of time");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "sched_early_max_ns", CTLFLAG_RD,
+	    &sc->sc_sched_early_max, 0,
+	    "Largest earliness of a timed event");
+	SYSCTL_ADD_UINT(ctx, tree, OID_AUTO, "storm_threshold", CTLFLAG_RW,
+	    &sc->sc_storm_threshold, 0,
+	    "Interrupts per pin per 100 ms before the pin is masked");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "storms", CTLFLAG_RD,
+	    &sc->sc_storms, 0, "Interrupt storms detected");
+	SYSCTL_ADD_U64(ctx, tree, OID_AUTO, "intr_unhandled", CTLFLAG_RD,
+	    &sc->sc_intr_unhandled, 0,
+	    "Interrupts on pins without a subscriber");
+	SYSCTL_ADD_PROC(ctx, tree, OID_AUTO, "pps_pin",
+	    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc, 0,
+	    gmlgpio_pps_pin_sysctl, "I",
+	    "Pin used as a PPS source through the control device, -1 for none");
+#ifdef GMLGPIO_MMIO_STATS
+	node = SYSCTL_ADD_NODE(ctx, tree, OID_AUTO, "mmio",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL,
+	    "Register access latency histograms, in TSC ticks");
+	for (i = 0; i < GMLGPIO_MMIO_NTYPES; i++)
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(node), OID_AUTO,
+		    gmlgpio_mmio_names[i],
+		    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc, i,
+		    gmlgpio_mmio_sysctl, "A", NULL);
+#endif
+
+	make_dev_args_init(&args);
+	args.mda_devsw = &gmlgpio_cdevsw;
+	args.mda_uid = UID_ROOT;
+	args.mda_gid = GID_WHEEL;
+	args.mda_mode = 0600;
+	args.mda_si_drv1 = sc;
+	error = make_dev_s(&args, &sc->sc_cdev, "gmlgpio%d",
+	    device_get_unit(dev));
+	if (error != 0)
+		device_printf(dev, "unable to create control device: error %d\n",
+		    error);
+
+	mtx_init(&sc->sc_vcd.vc_mtx, "gmlgpio vcd", NULL, MTX_SPIN);
+	sx_init(&sc->sc_vcd.vc_lock, "gmlgpio vcd reader");
+	args.mda_devsw = &gmlgpio_vcd_cdevsw;
+	args.mda_si_drv1 = &sc->sc_vcd;
+	args.mda_si_drv2 = sc;
+	error = make_dev_s(&args, &sc->sc_vcd_cdev, "gmlgpio%d.vcd",
+	    device_get_unit(dev));
+	if (error != 0)
+		device_printf(dev, "unable to create VCD device: error %d\n",
+		    error);
+
+	sx_xlock(&gmlgpio_communities_lock);
+	gmlgpio_communities[uid - 1] = sc;
+	sx_xunlock(&gmlgpio_communities_lock);
 
 	return (0);
 }
 
-/* Clear incoming interrupts */
+/*
+ * Count interrupts on the pending pins of one GPI_IS register.  Returns
+ * the pins that just crossed the storm threshold; they are recorded as
+ * masked and the storm callout is armed to unmask them.
+ */
+static uint32_t
+gmlgpio_storm_check(struct gmlgpio_softc *sc, int word, uint32_t pending,
+    sbintime_t now)
+{
+	struct gmlgpio_storm *st;
+	uint32_t storm;
+	int line;
+	int pin;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	storm = 0;
+	for (line = 0; pending != 0; line++, pending >>= 1) {
+		if ((pending & 1) == 0)
+			continue;
+		pin = word * 32 + line;
+		st = &sc->sc_storm[pin];
+		if (now - st->st_window > GMLGPIO_STORM_WINDOW) {
+			st->st_window = now;
+			st->st_count = 0;
+			if (st->st_backoff != 0 &&
+			    now - st->st_until > GMLGPIO_STORM_FORGET)
+				st->st_backoff = 0;
+		}
+		if (++st->st_count <= sc->sc_storm_threshold)
+			continue;
+
+		st->st_count = 0;
+		st->st_backoff = st->st_backoff == 0 ?
+		    GMLGPIO_STORM_BACKOFF_MIN :
+		    MIN(2 * st->st_backoff, GMLGPIO_STORM_BACKOFF_MAX);
+		st->st_until = now + st->st_backoff * SBT_1MS;
+		storm |= 1U << line;
+		sc->sc_storms++;
+
+		if (sc->sc_storm_next == 0 || st->st_until < sc->sc_storm_next) {
+			sc->sc_storm_next = st->st_until;
+			callout_reset_sbt(&sc->sc_storm_callout,
+			    sc->sc_storm_next, 0, gmlgpio_storm_run, sc,
+			    C_ABSOLUTE);
+		}
+	}
+	sc->sc_storm_masked[word] |= storm;
+	sc->sc_storm_report[word] |= storm;
+
+	return (storm);
+}
+
+/*
+ * Unmask pins whose storm backoff has expired, and log new storms.
+ */
 static void
-gmlgpio_intr(void *arg)
+gmlgpio_storm_run(void *arg)
+{
+	struct gmlgpio_softc *sc = arg;
+	struct gmlgpio_storm *st;
+	uint32_t report[GMLGPIO_MAPWORDS];
+	uint32_t expired;
+	bus_size_t offset;
+	sbintime_t now;
+	int word;
+	int line;
+	int pin;
+
+	now = sbinuptime();
+
+	GMLGPIO_LOCK(sc);
+	sc->sc_storm_next = 0;
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		report[word] = sc->sc_storm_report[word];
+		sc->sc_storm_report[word] = 0;
+
+		expired = 0;
+		for (line = 0; line < 32; line++) {
+			if ((sc->sc_storm_masked[word] & (1U << line)) == 0)
+				continue;
+			st = &sc->sc_storm[word * 32 + line];
+			if (st->st_until <= now)
+				expired |= 1U << line;
+			else if (sc->sc_storm_next == 0 ||
+			    st->st_until < sc->sc_storm_next)
+				sc->sc_storm_next = st->st_until;
+		}
+		if (expired == 0)
+			continue;
+		sc->sc_storm_masked[word] &= ~expired;
+		offset = 4 * word;
+		gmlgpio_write_gpi_is(sc, offset, expired);
+		bus_write_4(sc->sc_mem_res, GML_GPI_IE_0 + offset,
+		    bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + offset) | expired);
+	}
+	if (sc->sc_storm_next != 0)
+		callout_reset_sbt(&sc->sc_storm_callout, sc->sc_storm_next, 0,
+		    gmlgpio_storm_run, sc, C_ABSOLUTE);
+	GMLGPIO_UNLOCK(sc);
+
+	if (!ratecheck(&sc->sc_storm_lastlog, &gmlgpio_log_interval))
+		return;
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		for (line = 0; line < 32; line++) {
+			if ((report[word] & (1U << line)) == 0)
+				continue;
+			pin = word * 32 + line;
+			device_printf(sc->sc_dev,
+			    "interrupt storm on pin %d (%s), masked for %u ms\n",
+			    pin, sc->sc_pin_names[pin],
+			    sc->sc_storm[pin].st_backoff);
+		}
+	}
+}
+
+/*
+ * Call a pin's subscriber, if it has one that is not being torn down.
+ * Returns false if the pin has no subscriber at all.
+ */
+static bool
+gmlgpio_dispatch(struct gmlgpio_softc *sc, int pin)
+{
+	struct gmlgpio_handler *ih;
+	gmlgpio_intr_t *fn;
+	void *fnarg;
+
+	ih = &sc->sc_handlers[pin];
+	GMLGPIO_LOCK(sc);
+	if (ih->ih_fn == NULL) {
+		GMLGPIO_UNLOCK(sc);
+		return (false);
+	}
+	if (ih->ih_dying) {
+		GMLGPIO_UNLOCK(sc);
+		return (true);
+	}
+	fn = ih->ih_fn;
+	fnarg = ih->ih_arg;
+	ih->ih_busy++;
+	GMLGPIO_UNLOCK(sc);
+
+	fn(fnarg);
+
+	GMLGPIO_LOCK(sc);
+	ih->ih_busy--;
+	GMLGPIO_UNLOCK(sc);
+
+	return (true);
+}
+
+/*
+ * Expire the wheel slots up to the current tick.  A pin whose level now
+ * differs from the one last reported has settled on it: the change is
+ * recorded and the pin's subscriber, if any, called from here.
+ */
+static void
+gmlgpio_wheel_run(void *arg)
+{
+	struct gmlgpio_softc *sc = arg;
+	struct gmlgpio_debounce_pin *db;
+	uint32_t fire[GMLGPIO_MAPWORDS];
+	uint32_t bit;
+	uint64_t now;
+	uint64_t due;
+	unsigned int value;
+	bool any;
+	int next;
+	int slot;
+	int word;
+	int line;
+	int pin;
+	int i;
+
+	memset(fire, 0, sizeof(fire));
+	any = false;
+
+	GMLGPIO_LOCK(sc);
+	now = sbinuptime() / GMLGPIO_WHEEL_TICK;
+	for (i = 0; i < GMLGPIO_WHEEL_SLOTS && sc->sc_wheel_tick <= now;
+	    i++, sc->sc_wheel_tick++) {
+		slot = sc->sc_wheel_tick % GMLGPIO_WHEEL_SLOTS;
+		for (pin = sc->sc_wheel[slot]; pin >= 0; pin = next) {
+			db = &sc->sc_debounce[pin];
+			next = db->db_next;
+			if (db->db_deadline > now)
+				continue;
+			gmlgpio_wheel_remove(sc, pin);
+
+			bit = gmlgpio_gpi_bit(pin);
+			value = gmlgpio_pad_value(
+			    gmlgpio_read_pad_cfg_dw0(sc, pin));
+			if (((sc->sc_state[pin / 32] & bit) != 0) ==
+			    (value != GPIO_PIN_LOW))
+				continue;
+			gmlgpio_track(sc, pin, value);
+			if (sc->sc_handlers[pin].ih_fn != NULL) {
+				fire[pin / 32] |= bit;
+				any = true;
+			}
+		}
+	}
+	sc->sc_wheel_tick = MAX(sc->sc_wheel_tick, now + 1);
+
+	/*
+	 * Sleep until the nearest remaining deadline.  The walk is bounded
+	 * by the slots and the pins of one community, and only happens when
+	 * a deadline is due, not on every tick.
+	 */
+	if (sc->sc_wheel_count != 0) {
+		due = UINT64_MAX;
+		for (slot = 0; slot < GMLGPIO_WHEEL_SLOTS; slot++)
+			for (pin = sc->sc_wheel[slot]; pin >= 0;
+			    pin = sc->sc_debounce[pin].db_next)
+				due = MIN(due, sc->sc_debounce[pin].db_deadline);
+		gmlgpio_wheel_schedule(sc, due);
+	}
+	GMLGPIO_UNLOCK(sc);
+
+	if (!any)
+		return;
+
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		for (line = 0; fire[word] != 0; line++, fire[word] >>= 1)
+			if (fire[word] & 1)
+				gmlgpio_dispatch(sc, word * 32 + line);
+	}
+}
+
+/*
+ * Report the edge captured on entry to the filter.  When both edges are
+ * captured the pad's current level tells which one this was.
+ */
+static void
+gmlgpio_pps_event(struct gmlgpio_softc *sc)
+{
+	uint32_t val;
+	int event;
+
+	GMLGPIO_ASSERT_LOCKED(sc);
+
+	switch (sc->sc_pps.ppsparam.mode & PPS_CAPTUREBOTH) {
+	case PPS_CAPTUREASSERT:
+		event = PPS_CAPTUREASSERT;
+		break;
+	case PPS_CAPTURECLEAR:
+		event = PPS_CAPTURECLEAR;
+		break;
+	case PPS_CAPTUREBOTH:
+		val = gmlgpio_read_pad_cfg_dw0(sc, sc->sc_pps_pin);
+		event = (val & GML_GPIO_PAD_CFG_DW0_GPIORXSTATE) ?
+		    PPS_CAPTUREASSERT : PPS_CAPTURECLEAR;
+		break;
+	default:
+		return;
+	}
+	pps_event(&sc->sc_pps, event);
+}
+
+/*
+ * Ack incoming interrupts and run filter context subscribers.  Everything
+ * else is handed to gmlgpio_intr, with level triggered pins masked until
+ * their handler has run.
+ */
+static int
+gmlgpio_filter(void *arg)
 {
 	struct gmlgpio_softc *sc = arg;
-	uint32_t reg;
+	uint32_t pending;
+	uint32_t filter[GMLGPIO_MAPWORDS];
+	uint32_t rest;
+	uint32_t mask;
+	uint32_t pps;
+	uint32_t deb;
+	uint32_t bits;
+	bus_size_t offset;
+	sbintime_t now;
+	bool handled;
+	bool thread;
+	int word;
 	int line;
+
+	/* Take the PPS timestamp before anything else */
+	if (sc->sc_pps_pin >= 0)
+		pps_capture(&sc->sc_pps);
+
+	handled = false;
+	thread = false;
+	now = 0;
+
+	GMLGPIO_LOCK(sc);
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		offset = 4 * word;
+		pending = gmlgpio_read_gpi_is(sc, offset) &
+		    bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + offset);
+		filter[word] = pending & sc->sc_filter_mask[word];
+		if (pending == 0)
+			continue;
+		if (!handled)
+			now = sbinuptime();
+		handled = true;
+		gmlgpio_write_gpi_is(sc, offset, pending);
+
+		/* Debounced pins are only looked at again once settled */
+		deb = pending & sc->sc_debounce_mask[word];
+		for (bits = deb, line = 0; bits != 0; line++, bits >>= 1)
+			if (bits & 1)
+				gmlgpio_wheel_arm(sc, word * 32 + line, now);
+		gmlgpio_track_latched(sc, word, pending & ~deb);
+		filter[word] &= ~deb;
+
+		pps = 0;
+		if (sc->sc_pps_pin >= 0 && word == sc->sc_pps_pin / 32) {
+			pps = pending & gmlgpio_gpi_bit(sc->sc_pps_pin);
+			if (pps != 0)
+				gmlgpio_pps_event(sc);
+		}
+
+		/* Mask storming pins, and level pins until the ithread ran */
+		mask = gmlgpio_storm_check(sc, word, pending, now);
+		rest = pending & ~filter[word] & ~pps & ~deb;
+		mask |= rest & sc->sc_level_mask[word];
+		if (mask != 0)
+			bus_write_4(sc->sc_mem_res, GML_GPI_IE_0 + offset,
+			    bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + offset) &
+			    ~mask);
+		if (rest == 0)
+			continue;
+		sc->sc_thread_pending[word] |= rest;
+		thread = true;
+	}
+	GMLGPIO_UNLOCK(sc);
+
+	if (!handled)
+		return (FILTER_STRAY);
+
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		for (line = 0; filter[word] != 0; line++, filter[word] >>= 1)
+			if (filter[word] & 1)
+				gmlgpio_dispatch(sc, word * 32 + line);
+	}
+
+	return (thread ? FILTER_SCHEDULE_THREAD : FILTER_HANDLED);
+}
+
+/* Run ithread subscribers, and report interrupts nobody subscribed to */
+static void
+gmlgpio_intr(void *arg)
+{
+	struct gmlgpio_softc *sc = arg;
+	uint32_t pending[GMLGPIO_MAPWORDS];
+	uint32_t level;
 	bus_size_t offset;
+	int word;
+	int line;
+	int pin;
+
+	GMLGPIO_LOCK(sc);
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		pending[word] = sc->sc_thread_pending[word];
+		sc->sc_thread_pending[word] = 0;
+	}
+	GMLGPIO_UNLOCK(sc);
 
-	for (offset = GML_GPI_IS_0; offset <= GML_GPI_IS_3; offset += 4) {
-		reg = bus_read_4(sc->sc_mem_res, offset);
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
 		for (line = 0; line < 32; line++) {
-			if ((reg & (1 << line)) == 0)
+			if ((pending[word] & (1U << line)) == 0)
 				continue;
-			bus_write_4(sc->sc_mem_res, offset, 1 << line);
-			device_printf(sc->sc_dev, "cleared interrupt on gpio bit %d\n",
-			    (int)offset * 32 + line);
+			pin = word * 32 + line;
+			if (gmlgpio_dispatch(sc, pin))
+				continue;
+			sc->sc_intr_unhandled++;
+			if (ratecheck(&sc->sc_intr_lastlog,
+			    &gmlgpio_log_interval))
+				device_printf(sc->sc_dev,
+				    "cleared interrupt on gpio bit %d\n", pin);
 		}
 	}
+
+	GMLGPIO_LOCK(sc);
+	for (word = 0; word < GMLGPIO_MAPWORDS; word++) {
+		level = pending[word] & sc->sc_level_mask[word] &
+		    ~sc->sc_storm_masked[word];
+		if (level == 0)
+			continue;
+		offset = 4 * word;
+		gmlgpio_write_gpi_is(sc, offset, level);
+		bus_write_4(sc->sc_mem_res, GML_GPI_IE_0 + offset,
+		    bus_read_4(sc->sc_mem_res, GML_GPI_IE_0 + offset) | level);
+	}
+	GMLGPIO_UNLOCK(sc);
 }
 
 static int
 gmlgpio_detach(device_t dev)
 {
 	struct gmlgpio_softc *sc;
+	int pin;
+
 	sc = device_get_softc(dev);
 
+	/* Subscribers hold references to this device */
+	for (pin = 0; pin < sc->sc_npins; pin++)
+		if (sc->sc_handlers[pin].ih_fn != NULL)
+			return (EBUSY);
+
+	if (sc->sc_uid != 0) {
+		sx_xlock(&gmlgpio_communities_lock);
+		gmlgpio_communities[sc->sc_uid - 1] = NULL;
+		sx_xunlock(&gmlgpio_communities_lock);
+	}
+
+	if (sc->sc_cdev != NULL)
+		destroy_dev(sc->sc_cdev);
+	if (sc->sc_vcd_cdev != NULL)
+		destroy_dev(sc->sc_vcd_cdev);
+	gmlgpio_vcd_release(&sc->sc_vcd);
+
+	GMLGPIO_LOCK(sc);
+	sc->sc_nsched = 0;
+	GMLGPIO_UNLOCK(sc);
+	callout_drain(&sc->sc_sched_callout);
+
 	if (sc->sc_busdev)
 		gpiobus_detach_bus(dev);
 
 	if (sc->intr_handle != NULL)
 		bus_teardown_intr(sc->sc_dev, sc->sc_irq_res, sc->intr_handle);
+	/* The filter arms these callouts, so drain them only now */
+	callout_drain(&sc->sc_storm_callout);
+	callout_drain(&sc->sc_wheel_callout);
 	if (sc->sc_irq_res != NULL)
 		bus_release_resource(dev, SYS_RES_IRQ, sc->sc_irq_rid, sc->sc_irq_res);
 	if (sc->sc_mem_res != NULL)
 		bus_release_resource(dev, SYS_RES_MEMORY, sc->sc_mem_rid,
 		    sc->sc_mem_res);
 
+	sx_destroy(&sc->sc_vcd.vc_lock);
+	mtx_destroy(&sc->sc_vcd.vc_mtx);
 	GMLGPIO_LOCK_DESTROY(sc);
 
     return (0);
@@ -567,7 +2993,43 @@ static driver_t gmlgpio_driver = {
     .size = sizeof(struct gmlgpio_softc)
 };
 
-DRIVER_MODULE(gmlgpio, acpi, gmlgpio_driver, NULL , NULL);
+static int
+gmlgpio_modevent(module_t mod, int type, void *data)
+{
+	struct make_dev_args args;
+	int error;
+
+	switch (type) {
+	case MOD_LOAD:
+		make_dev_args_init(&args);
+		args.mda_devsw = &gmlgpio_all_cdevsw;
+		args.mda_uid = UID_ROOT;
+		args.mda_gid = GID_WHEEL;
+		args.mda_mode = 0600;
+		error = make_dev_s(&args, &gmlgpio_all_cdev, "gmlgpio");
+		if (error != 0)
+			return (error);
+		args.mda_devsw = &gmlgpio_vcd_cdevsw;
+		args.mda_si_drv1 = &gmlgpio_all_vcd;
+		error = make_dev_s(&args, &gmlgpio_all_vcd_cdev, "gmlgpio.vcd");
+		if (error != 0) {
+			destroy_dev(gmlgpio_all_cdev);
+			gmlgpio_all_cdev = NULL;
+		}
+		return (error);
+	case MOD_UNLOAD:
+		if (gmlgpio_all_vcd_cdev != NULL)
+			destroy_dev(gmlgpio_all_vcd_cdev);
+		gmlgpio_vcd_release(&gmlgpio_all_vcd);
+		if (gmlgpio_all_cdev != NULL)
+			destroy_dev(gmlgpio_all_cdev);
+		return (0);
+	default:
+		return (0);
+	}
+}
+
+DRIVER_MODULE(gmlgpio, acpi, gmlgpio_driver, gmlgpio_modevent, NULL);
 MODULE_DEPEND(gmlgpio, acpi, 1, 1, 1);
 MODULE_DEPEND(gmlgpio, gpiobus, 1, 1, 1);
 
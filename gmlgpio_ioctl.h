@@ -0,0 +1,220 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Interfaces exported through /dev/gmlgpioN, one per community, and
+ * /dev/gmlgpio, which spans all of them.  These supplement the generic
+ * gpioc(4) interface with operations that work on many pins at once.
+ */
+
+#ifndef _GMLGPIO_IOCTL_H_
+#define	_GMLGPIO_IOCTL_H_
+
+#include <sys/types.h>
+#include <sys/ioccom.h>
+#include <sys/gpio.h>
+
+/* Largest community (NORTHWEST) has 111 pads */
+#define	GMLGPIO_MAXPINS		128
+#define	GMLGPIO_MAPWORDS	(GMLGPIO_MAXPINS / 32)
+
+/*
+ * Community snapshot.  With gs_generation set to 0 every pin is sampled
+ * and reported.  Otherwise only pins whose state changed after that
+ * generation are set in gs_changed, and only those bits of gs_state are
+ * meaningful.  On return gs_generation holds the generation to pass to
+ * the next call.
+ *
+ * Changes are tracked through writes made by this driver and through the
+ * GPI_IS latches, so a delta only sees input changes that the pad's receive
+ * event configuration latches.  Level and both-edge configurations catch
+ * both directions; a single-edge configuration misses the opposite
+ * transition.  A full snapshot resynchronizes the tracking with the
+ * hardware.
+ */
+struct gmlgpio_snapshot {
+	uint64_t	gs_generation;
+	uint32_t	gs_npins;
+	uint32_t	gs_pad;
+	uint32_t	gs_state[GMLGPIO_MAPWORDS];
+	uint32_t	gs_changed[GMLGPIO_MAPWORDS];
+};
+
+/*
+ * Virtual parallel port.  Data pads are listed least significant bit
+ * first and must all be outputs in the same community.  Each word passed
+ * to write(2) on /dev/gmlgpioN is presented on the data pads, followed by
+ * a pulse on the strobe pad if one is configured.  The latch pad, if any,
+ * is pulsed once after the whole buffer has been written.  Words are one
+ * byte for ports up to 8 bits wide and two bytes, little endian, above.
+ * A width of 0 disables the port.
+ */
+#define	GMLGPIO_PORT_MAXWIDTH	16
+
+struct gmlgpio_port {
+	uint32_t	gp_width;
+	uint32_t	gp_flags;
+	int32_t		gp_data[GMLGPIO_PORT_MAXWIDTH];
+	int32_t		gp_strobe;		/* -1 if unused */
+	int32_t		gp_latch;		/* -1 if unused */
+};
+
+#define	GMLGPIO_PORT_STROBE_LOW	0x0001	/* Strobe is active low */
+#define	GMLGPIO_PORT_LATCH_LOW	0x0002	/* Latch is active low */
+
+/*
+ * Batched pin operations, applied in order.  Each operation reports its
+ * own error in go_error; the ioctl itself only fails if the batch cannot
+ * be copied in or out.
+ */
+#define	GMLGPIO_OP_GET		0	/* go_value <- pin value */
+#define	GMLGPIO_OP_SET		1	/* pin value <- go_value */
+#define	GMLGPIO_OP_TOGGLE	2
+#define	GMLGPIO_OP_GETFLAGS	3	/* go_value <- GPIO_PIN_* flags */
+#define	GMLGPIO_OP_SETFLAGS	4	/* GPIO_PIN_* flags <- go_value */
+
+struct gmlgpio_op {
+	uint16_t	go_pin;
+	uint8_t		go_op;
+	uint8_t		go_pad;
+	uint32_t	go_value;
+	int32_t		go_error;
+};
+
+#define	GMLGPIO_MAXBATCH	1024
+
+struct gmlgpio_batch {
+	uint32_t	gb_count;
+	uint32_t	gb_pad;
+	struct gmlgpio_op *gb_ops;
+};
+
+/*
+ * Pin names of the community, as given by gpioctl(8).  gn_names must have
+ * room for GMLGPIO_MAXPINS names; gn_npins is set to the number returned.
+ */
+struct gmlgpio_pinnames {
+	uint32_t	gn_npins;
+	uint32_t	gn_pad;
+	char		(*gn_names)[GPIOMAXNAME];
+};
+
+/*
+ * Coherent sample of pins across communities, through /dev/gmlgpio.
+ * gx_unit is the unit of the community's /dev/gmlgpioN.  All pins are
+ * read back to back with interrupts disabled; gx_timestamp is the uptime
+ * in nanoseconds at the middle of the sequence and gx_skew the time in
+ * nanoseconds between its first and last read.
+ */
+struct gmlgpio_xpin {
+	uint16_t	gx_unit;
+	uint16_t	gx_pin;
+	uint32_t	gx_value;
+};
+
+#define	GMLGPIO_MAXXSAMPLE	512
+
+struct gmlgpio_xsample {
+	uint32_t	gx_count;
+	uint32_t	gx_pad;
+	struct gmlgpio_xpin *gx_pins;
+	uint64_t	gx_timestamp;
+	uint64_t	gx_skew;
+};
+
+/*
+ * Timed output events.  Each event sets an output pin to ge_value at
+ * ge_when, an absolute CLOCK_UPTIME time in nanoseconds.  Events due
+ * within the community's tolerance (sysctl dev.gpio.N.sched_tolerance_ns)
+ * of each other are written in one pass.  GMLGPIO_SCHEDULE fails with
+ * ENOSPC, queueing nothing, if the events do not all fit, and with EINVAL
+ * if a time is beyond what sbintime_t can hold (about 68 years of uptime).
+ */
+struct gmlgpio_event {
+	uint16_t	ge_pin;
+	uint16_t	ge_value;
+	uint32_t	ge_pad;
+	uint64_t	ge_when;
+};
+
+#define	GMLGPIO_MAXEVENTS	256
+
+struct gmlgpio_schedule {
+	uint32_t	gs_count;
+	uint32_t	gs_pad;
+	struct gmlgpio_event *gs_events;
+};
+
+/*
+ * Pad configuration of a whole community, as the raw DW0 and DW1 register
+ * values.  GMLGPIO_GETCONFIG fills in every field.  GMLGPIO_SETCONFIG
+ * checks gc_version, gc_uid and gc_npins against the community, then
+ * writes only the registers that differ from the hardware, all under one
+ * lock hold, and returns the number of pads written in gc_written.  It
+ * fails with EBUSY, writing nothing, if a pad that would change is in use
+ * by a kernel interrupt subscriber or as the PPS source.  The read only
+ * RX state bit of DW0 is ignored.
+ */
+#define	GMLGPIO_CONFIG_VERSION	1
+
+struct gmlgpio_config {
+	uint32_t	gc_version;
+	uint32_t	gc_uid;			/* ACPI _UID of the community */
+	uint32_t	gc_npins;
+	uint32_t	gc_written;
+	uint32_t	gc_dw0[GMLGPIO_MAXPINS];
+	uint32_t	gc_dw1[GMLGPIO_MAXPINS];
+};
+
+/*
+ * Software debounce of a pin interrupting on both edges.  A change is
+ * only reported, to snapshots, VCD readers and kernel subscribers, once
+ * the pin has kept its new level for gd_rise_ms (low to high) or
+ * gd_fall_ms (high to low).  Both 0 turns debouncing off.  The setting is
+ * dropped when the pin is given any other interrupt mode.
+ */
+struct gmlgpio_debounce {
+	uint16_t	gd_pin;
+	uint16_t	gd_rise_ms;
+	uint16_t	gd_fall_ms;
+	uint16_t	gd_pad;
+};
+
+#define	GMLGPIO_SNAPSHOT	_IOWR('g', 0, struct gmlgpio_snapshot)
+#define	GMLGPIO_SETPORT		_IOW('g', 1, struct gmlgpio_port)
+#define	GMLGPIO_GETPORT		_IOR('g', 2, struct gmlgpio_port)
+#define	GMLGPIO_BATCH		_IOW('g', 3, struct gmlgpio_batch)
+#define	GMLGPIO_PINNAMES	_IOWR('g', 4, struct gmlgpio_pinnames)
+#define	GMLGPIO_XSAMPLE		_IOWR('g', 5, struct gmlgpio_xsample)
+#define	GMLGPIO_SCHEDULE	_IOW('g', 6, struct gmlgpio_schedule)
+#define	GMLGPIO_SCHEDFLUSH	_IO('g', 7)
+#define	GMLGPIO_GETCONFIG	_IOR('g', 8, struct gmlgpio_config)
+#define	GMLGPIO_SETCONFIG	_IOWR('g', 9, struct gmlgpio_config)
+#define	GMLGPIO_SETDEBOUNCE	_IOW('g', 10, struct gmlgpio_debounce)
+#define	GMLGPIO_GETDEBOUNCE	_IOWR('g', 11, struct gmlgpio_debounce)
+
+#endif /* _GMLGPIO_IOCTL_H_ */
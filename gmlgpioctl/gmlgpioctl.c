@@ -0,0 +1,298 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libgmlgpio.h"
+
+static gmlgpio_handle_t handle;
+static struct gmlgpio_req *reqs;
+static size_t nreqs;
+static size_t maxreqs;
+
+static const struct {
+	const char	*name;
+	uint32_t	flag;
+} pinflags[] = {
+	{ "in",		GPIO_PIN_INPUT },
+	{ "out",	GPIO_PIN_OUTPUT },
+	{ "intr_ll",	GPIO_INTR_LEVEL_LOW },
+	{ "intr_lh",	GPIO_INTR_LEVEL_HIGH },
+	{ "intr_er",	GPIO_INTR_EDGE_RISING },
+	{ "intr_ef",	GPIO_INTR_EDGE_FALLING },
+	{ "intr_eb",	GPIO_INTR_EDGE_BOTH },
+};
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: gmlgpioctl [-qt] [-n count] -f script\n"
+	    "       gmlgpioctl [-qt] [-n count] command ...\n"
+	    "commands:\n"
+	    "       get pin\n"
+	    "       set pin 0|1\n"
+	    "       toggle pin\n"
+	    "       flags pin\n"
+	    "       config pin flag[,flag...]\n");
+	exit(1);
+}
+
+static uint32_t
+parse_flags(const char *where, char *list)
+{
+	uint32_t flags;
+	char *word;
+	size_t i;
+
+	flags = 0;
+	while ((word = strsep(&list, ",")) != NULL) {
+		for (i = 0; i < nitems(pinflags); i++)
+			if (strcmp(word, pinflags[i].name) == 0)
+				break;
+		if (i == nitems(pinflags))
+			errx(1, "%s: unknown flag \"%s\"", where, word);
+		flags |= pinflags[i].flag;
+	}
+
+	return (flags);
+}
+
+static void
+print_flags(uint32_t flags)
+{
+	const char *sep;
+	size_t i;
+
+	sep = "";
+	for (i = 0; i < nitems(pinflags); i++) {
+		if (flags & pinflags[i].flag) {
+			printf("%s%s", sep, pinflags[i].name);
+			sep = ",";
+		}
+	}
+	printf("\n");
+}
+
+/*
+ * Parse one command from argv, resolving its pin, and append it to the
+ * request list.  Returns the number of words consumed.
+ */
+static int
+parse_command(const char *where, int argc, char **argv)
+{
+	struct gmlgpio_req *r;
+	char *end;
+	int needed;
+
+	if (nreqs == maxreqs) {
+		maxreqs = maxreqs ? 2 * maxreqs : 256;
+		reqs = reallocarray(reqs, maxreqs, sizeof(*reqs));
+		if (reqs == NULL)
+			err(1, "reallocarray");
+	}
+	r = &reqs[nreqs];
+	memset(r, 0, sizeof(*r));
+
+	if (strcmp(argv[0], "get") == 0) {
+		r->gr_op = GMLGPIO_OP_GET;
+		needed = 2;
+	} else if (strcmp(argv[0], "set") == 0) {
+		r->gr_op = GMLGPIO_OP_SET;
+		needed = 3;
+	} else if (strcmp(argv[0], "toggle") == 0) {
+		r->gr_op = GMLGPIO_OP_TOGGLE;
+		needed = 2;
+	} else if (strcmp(argv[0], "flags") == 0) {
+		r->gr_op = GMLGPIO_OP_GETFLAGS;
+		needed = 2;
+	} else if (strcmp(argv[0], "config") == 0) {
+		r->gr_op = GMLGPIO_OP_SETFLAGS;
+		needed = 3;
+	} else
+		errx(1, "%s: unknown command \"%s\"", where, argv[0]);
+
+	if (argc < needed)
+		errx(1, "%s: %s: missing argument", where, argv[0]);
+	if (gmlgpio_lookup(handle, argv[1], &r->gr_pin) < 0)
+		err(1, "%s: %s", where, argv[1]);
+
+	if (r->gr_op == GMLGPIO_OP_SET) {
+		r->gr_value = strtoul(argv[2], &end, 0);
+		if (*end != '\0' || r->gr_value > 1)
+			errx(1, "%s: invalid value \"%s\"", where, argv[2]);
+	} else if (r->gr_op == GMLGPIO_OP_SETFLAGS)
+		r->gr_value = parse_flags(where, argv[2]);
+
+	nreqs++;
+	return (needed);
+}
+
+static void
+parse_script(const char *path)
+{
+	FILE *fp;
+	char where[128];
+	char *line;
+	char *p;
+	char *words[4];
+	size_t linecap;
+	int lineno;
+	int nwords;
+
+	if (strcmp(path, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(path, "r")) == NULL)
+		err(1, "%s", path);
+
+	line = NULL;
+	linecap = 0;
+	lineno = 0;
+	while (getline(&line, &linecap, fp) > 0) {
+		lineno++;
+		snprintf(where, sizeof(where), "%s:%d", path, lineno);
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		nwords = 0;
+		p = line;
+		while (nwords < (int)nitems(words) &&
+		    (words[nwords] = strsep(&p, " \t\n")) != NULL)
+			if (*words[nwords] != '\0')
+				nwords++;
+		if (nwords == 0)
+			continue;
+		if (parse_command(where, nwords, words) != nwords)
+			errx(1, "%s: trailing garbage", where);
+	}
+	if (ferror(fp))
+		err(1, "%s", path);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct timespec start, end;
+	const char *script;
+	const char *name;
+	double elapsed;
+	long count;
+	long i;
+	size_t n;
+	int qflag;
+	int tflag;
+	int status;
+	int ch;
+
+	script = NULL;
+	count = 1;
+	qflag = tflag = 0;
+	while ((ch = getopt(argc, argv, "f:n:qt")) != -1) {
+		switch (ch) {
+		case 'f':
+			script = optarg;
+			break;
+		case 'n':
+			count = strtol(optarg, NULL, 0);
+			if (count < 1)
+				errx(1, "invalid count \"%s\"", optarg);
+			break;
+		case 'q':
+			qflag = 1;
+			break;
+		case 't':
+			tflag = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if ((script == NULL) == (argc == 0))
+		usage();
+
+	handle = gmlgpio_open();
+	if (handle == NULL)
+		err(1, "gmlgpio_open");
+
+	/* Resolve everything up front so the timed loop is only ioctls */
+	if (script != NULL)
+		parse_script(script);
+	else
+		for (i = 0; i < argc; i += n)
+			n = parse_command("argument", argc - i, argv + i);
+
+	status = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+		if (gmlgpio_batch(handle, reqs, nreqs) < 0)
+			status = 1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (n = 0; n < nreqs; n++) {
+		name = gmlgpio_name(handle, &reqs[n].gr_pin);
+		if (reqs[n].gr_error != 0) {
+			warnc(reqs[n].gr_error, "%s", name);
+			continue;
+		}
+		if (qflag)
+			continue;
+		if (reqs[n].gr_op == GMLGPIO_OP_GET)
+			printf("%s %u\n", name, reqs[n].gr_value);
+		else if (reqs[n].gr_op == GMLGPIO_OP_GETFLAGS) {
+			printf("%s ", name);
+			print_flags(reqs[n].gr_value);
+		}
+	}
+
+	if (tflag) {
+		elapsed = (end.tv_sec - start.tv_sec) +
+		    (end.tv_nsec - start.tv_nsec) / 1e9;
+		fprintf(stderr, "%zu ops in %.6f s (%.0f ops/sec)\n",
+		    nreqs * count, elapsed,
+		    elapsed > 0 ? nreqs * count / elapsed : 0);
+	}
+
+	gmlgpio_close(handle);
+	free(reqs);
+
+	return (status);
+}
@@ -0,0 +1,69 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Kernel interfaces for drivers that consume gmlgpio pin events.
+ * Consumers should declare MODULE_DEPEND(..., gmlgpio, 1, 1, 1), and
+ * include the ACPICA headers before this one.
+ */
+
+#ifndef _GMLGPIOVAR_H_
+#define	_GMLGPIOVAR_H_
+
+typedef void gmlgpio_intr_t(void *);
+
+/* Flags for gmlgpio_intr_establish() */
+#define	GMLGPIO_INTR_FILTER	0x0001	/* Call from the interrupt filter */
+
+/*
+ * Attach a handler to a pin.  mode is one of the GPIO_INTR_* values from
+ * <sys/gpio.h>; the pin is made an input and its interrupt enabled.
+ *
+ * Handlers are called from the ithread unless GMLGPIO_INTR_FILTER is
+ * given, in which case they run in filter context and must not sleep or
+ * take sleep locks.  A level triggered pin delivered to the ithread is
+ * masked until its handler returns; a filter handler for a level
+ * triggered pin must quiet the source itself.
+ *
+ * gmlgpio_intr_disestablish() may sleep until a running call of the pin's
+ * handler returns, so it must not be called from a handler.
+ */
+int	gmlgpio_intr_establish(device_t dev, int pin, uint32_t mode, int flags,
+	    gmlgpio_intr_t *handler, void *arg);
+int	gmlgpio_intr_disestablish(device_t dev, int pin);
+
+/*
+ * Attach a handler to the index'th GpioInt resource in the _CRS of an
+ * ACPI device.  The owning community and pad are looked up from the
+ * descriptor, and the mode from its triggering and polarity.  The cookie
+ * returned is passed to gmlgpio_acpi_intr_disestablish().
+ */
+int	gmlgpio_acpi_intr_establish(ACPI_HANDLE handle, int index, int flags,
+	    gmlgpio_intr_t *handler, void *arg, void **cookiep);
+int	gmlgpio_acpi_intr_disestablish(void *cookie);
+
+#endif /* _GMLGPIOVAR_H_ */
@@ -0,0 +1,319 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libgmlgpio.h"
+
+/* Control device units probed by gmlgpio_open() */
+#define	GMLGPIO_MAXUNITS	16
+
+struct gmlgpio_unit {
+	int		gu_fd;
+	int		gu_npins;
+	char		(*gu_names)[GPIOMAXNAME];
+};
+
+struct gmlgpio_name {
+	const char	*gn_name;
+	struct gmlgpio_pin gn_pin;
+};
+
+struct gmlgpio_handle {
+	struct gmlgpio_unit gh_units[GMLGPIO_MAXUNITS];
+	struct gmlgpio_name *gh_index;
+	size_t		gh_nindex;
+	struct gmlgpio_op gh_ops[GMLGPIO_MAXBATCH];
+};
+
+static int
+gmlgpio_name_cmp(const void *a, const void *b)
+{
+	return (strcmp(((const struct gmlgpio_name *)a)->gn_name,
+	    ((const struct gmlgpio_name *)b)->gn_name));
+}
+
+gmlgpio_handle_t
+gmlgpio_open(void)
+{
+	struct gmlgpio_handle *h;
+	struct gmlgpio_unit *u;
+	struct gmlgpio_pinnames gn;
+	char path[sizeof(_PATH_DEV) + 16];
+	size_t n;
+	int unit;
+	int pin;
+
+	h = calloc(1, sizeof(*h));
+	if (h == NULL)
+		return (NULL);
+	for (unit = 0; unit < GMLGPIO_MAXUNITS; unit++)
+		h->gh_units[unit].gu_fd = -1;
+
+	n = 0;
+	for (unit = 0; unit < GMLGPIO_MAXUNITS; unit++) {
+		u = &h->gh_units[unit];
+		snprintf(path, sizeof(path), "%sgmlgpio%d", _PATH_DEV, unit);
+		u->gu_fd = open(path, O_RDWR);
+		if (u->gu_fd < 0)
+			continue;
+		u->gu_names = calloc(GMLGPIO_MAXPINS, GPIOMAXNAME);
+		if (u->gu_names == NULL)
+			goto fail;
+		memset(&gn, 0, sizeof(gn));
+		gn.gn_names = u->gu_names;
+		if (ioctl(u->gu_fd, GMLGPIO_PINNAMES, &gn) < 0)
+			goto fail;
+		u->gu_npins = gn.gn_npins;
+		n += u->gu_npins;
+	}
+	if (n == 0) {
+		errno = ENXIO;
+		goto fail;
+	}
+
+	h->gh_index = calloc(n, sizeof(*h->gh_index));
+	if (h->gh_index == NULL)
+		goto fail;
+	for (unit = 0; unit < GMLGPIO_MAXUNITS; unit++) {
+		u = &h->gh_units[unit];
+		for (pin = 0; pin < u->gu_npins; pin++) {
+			h->gh_index[h->gh_nindex].gn_name = u->gu_names[pin];
+			h->gh_index[h->gh_nindex].gn_pin.gp_unit = unit;
+			h->gh_index[h->gh_nindex].gn_pin.gp_pin = pin;
+			h->gh_nindex++;
+		}
+	}
+	qsort(h->gh_index, h->gh_nindex, sizeof(*h->gh_index),
+	    gmlgpio_name_cmp);
+
+	return (h);
+
+fail:
+	gmlgpio_close(h);
+	return (NULL);
+}
+
+void
+gmlgpio_close(gmlgpio_handle_t h)
+{
+	int saved_errno;
+	int unit;
+
+	saved_errno = errno;
+	for (unit = 0; unit < GMLGPIO_MAXUNITS; unit++) {
+		if (h->gh_units[unit].gu_fd >= 0)
+			close(h->gh_units[unit].gu_fd);
+		free(h->gh_units[unit].gu_names);
+	}
+	free(h->gh_index);
+	free(h);
+	errno = saved_errno;
+}
+
+static int
+gmlgpio_valid(gmlgpio_handle_t h, const struct gmlgpio_pin *p)
+{
+	if (p->gp_unit < 0 || p->gp_unit >= GMLGPIO_MAXUNITS ||
+	    p->gp_pin < 0 || p->gp_pin >= h->gh_units[p->gp_unit].gu_npins)
+		return (0);
+	return (1);
+}
+
+int
+gmlgpio_lookup(gmlgpio_handle_t h, const char *name, struct gmlgpio_pin *p)
+{
+	struct gmlgpio_name key;
+	struct gmlgpio_name *found;
+	struct gmlgpio_unit *u;
+	const char *colon;
+	char *end;
+	long unit;
+	long pin;
+
+	colon = strchr(name, ':');
+	if (colon == NULL) {
+		key.gn_name = name;
+		found = bsearch(&key, h->gh_index, h->gh_nindex,
+		    sizeof(*h->gh_index), gmlgpio_name_cmp);
+		if (found == NULL) {
+			errno = ENOENT;
+			return (-1);
+		}
+		*p = found->gn_pin;
+		return (0);
+	}
+
+	unit = strtol(name, &end, 10);
+	if (end != colon || unit < 0 || unit >= GMLGPIO_MAXUNITS) {
+		errno = EINVAL;
+		return (-1);
+	}
+	u = &h->gh_units[unit];
+	p->gp_unit = unit;
+
+	pin = strtol(colon + 1, &end, 10);
+	if (colon[1] != '\0' && *end == '\0') {
+		p->gp_pin = pin;
+	} else {
+		for (pin = 0; pin < u->gu_npins; pin++)
+			if (strcmp(u->gu_names[pin], colon + 1) == 0)
+				break;
+		p->gp_pin = pin;
+	}
+	if (!gmlgpio_valid(h, p)) {
+		errno = ENOENT;
+		return (-1);
+	}
+
+	return (0);
+}
+
+const char *
+gmlgpio_name(gmlgpio_handle_t h, const struct gmlgpio_pin *p)
+{
+	if (!gmlgpio_valid(h, p))
+		return (NULL);
+	return (h->gh_units[p->gp_unit].gu_names[p->gp_pin]);
+}
+
+int
+gmlgpio_batch(gmlgpio_handle_t h, struct gmlgpio_req *reqs, size_t nreqs)
+{
+	struct gmlgpio_batch gb;
+	struct gmlgpio_req *r;
+	struct gmlgpio_op *op;
+	int first_error;
+	size_t start;
+	size_t n;
+	size_t i;
+	int unit;
+
+	first_error = 0;
+	for (start = 0; start < nreqs; start += n) {
+		if (!gmlgpio_valid(h, &reqs[start].gr_pin)) {
+			reqs[start].gr_error = EINVAL;
+			if (first_error == 0)
+				first_error = EINVAL;
+			n = 1;
+			continue;
+		}
+
+		/* Run of consecutive operations on one community */
+		unit = reqs[start].gr_pin.gp_unit;
+		for (n = 0; start + n < nreqs && n < GMLGPIO_MAXBATCH; n++) {
+			r = &reqs[start + n];
+			if (r->gr_pin.gp_unit != unit ||
+			    !gmlgpio_valid(h, &r->gr_pin))
+				break;
+			op = &h->gh_ops[n];
+			op->go_pin = r->gr_pin.gp_pin;
+			op->go_op = r->gr_op;
+			op->go_value = r->gr_value;
+			op->go_error = 0;
+		}
+
+		gb.gb_count = n;
+		gb.gb_ops = h->gh_ops;
+		if (ioctl(h->gh_units[unit].gu_fd, GMLGPIO_BATCH, &gb) < 0)
+			return (-1);
+
+		for (i = 0; i < n; i++) {
+			reqs[start + i].gr_value = h->gh_ops[i].go_value;
+			reqs[start + i].gr_error = h->gh_ops[i].go_error;
+			if (first_error == 0)
+				first_error = h->gh_ops[i].go_error;
+		}
+	}
+
+	if (first_error != 0) {
+		errno = first_error;
+		return (-1);
+	}
+	return (0);
+}
+
+/* in supplies the values for SET and SETFLAGS, out receives those of GET */
+static int
+gmlgpio_simple(gmlgpio_handle_t h, int opcode, const struct gmlgpio_pin *pins,
+    const uint32_t *in, uint32_t *out, size_t npins)
+{
+	struct gmlgpio_req *reqs;
+	size_t i;
+	int error;
+
+	reqs = calloc(npins, sizeof(*reqs));
+	if (reqs == NULL)
+		return (-1);
+	for (i = 0; i < npins; i++) {
+		reqs[i].gr_pin = pins[i];
+		reqs[i].gr_op = opcode;
+		if (in != NULL)
+			reqs[i].gr_value = in[i];
+	}
+	error = gmlgpio_batch(h, reqs, npins);
+	if (out != NULL)
+		for (i = 0; i < npins; i++)
+			out[i] = reqs[i].gr_value;
+	free(reqs);
+
+	return (error);
+}
+
+int
+gmlgpio_get(gmlgpio_handle_t h, const struct gmlgpio_pin *pins,
+    uint32_t *values, size_t npins)
+{
+	return (gmlgpio_simple(h, GMLGPIO_OP_GET, pins, NULL, values, npins));
+}
+
+int
+gmlgpio_set(gmlgpio_handle_t h, const struct gmlgpio_pin *pins,
+    const uint32_t *values, size_t npins)
+{
+	return (gmlgpio_simple(h, GMLGPIO_OP_SET, pins, values, NULL, npins));
+}
+
+int
+gmlgpio_config(gmlgpio_handle_t h, const struct gmlgpio_pin *pins,
+    const uint32_t *flags, size_t npins)
+{
+	return (gmlgpio_simple(h, GMLGPIO_OP_SETFLAGS, pins, flags, NULL,
+	    npins));
+}
@@ -0,0 +1,83 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Userland access to the gmlgpio control devices.  All communities are
+ * opened once, and pin names are resolved from a table read from the
+ * driver at open time.  Operations are submitted in batches, one ioctl
+ * per run of consecutive operations on the same community.
+ */
+
+#ifndef _LIBGMLGPIO_H_
+#define	_LIBGMLGPIO_H_
+
+#include <sys/types.h>
+
+#include "gmlgpio_ioctl.h"
+
+typedef struct gmlgpio_handle *gmlgpio_handle_t;
+
+/* A resolved pin: control device unit and pad index within it */
+struct gmlgpio_pin {
+	int		gp_unit;
+	int		gp_pin;
+};
+
+/* One operation; gr_op is a GMLGPIO_OP_* value */
+struct gmlgpio_req {
+	struct gmlgpio_pin gr_pin;
+	int		gr_op;
+	uint32_t	gr_value;
+	int		gr_error;
+};
+
+__BEGIN_DECLS
+gmlgpio_handle_t gmlgpio_open(void);
+void	gmlgpio_close(gmlgpio_handle_t);
+
+/*
+ * Names are either a pin name as listed by gpioctl(8), "unit:name", or
+ * "unit:number".
+ */
+int	gmlgpio_lookup(gmlgpio_handle_t, const char *, struct gmlgpio_pin *);
+const char *gmlgpio_name(gmlgpio_handle_t, const struct gmlgpio_pin *);
+
+/*
+ * Run operations in order.  Returns 0 if they all succeeded; otherwise
+ * -1 with errno set to the first failure, and each gr_error filled in.
+ */
+int	gmlgpio_batch(gmlgpio_handle_t, struct gmlgpio_req *, size_t);
+
+int	gmlgpio_get(gmlgpio_handle_t, const struct gmlgpio_pin *, uint32_t *,
+	    size_t);
+int	gmlgpio_set(gmlgpio_handle_t, const struct gmlgpio_pin *,
+	    const uint32_t *, size_t);
+int	gmlgpio_config(gmlgpio_handle_t, const struct gmlgpio_pin *,
+	    const uint32_t *, size_t);
+__END_DECLS
+
+#endif /* _LIBGMLGPIO_H_ */